@@ -18,62 +18,117 @@ typedef enum
 /* lexeme of identifier or reserved word */
 char tokenString[MAXTOKENLEN+1];
 
-/* BUFLEN = length of the input buffer for
-   source code lines */
-#define BUFLEN 256
+/* BUFLEN = initial size of the input buffer, which
+   is filled with blocks of the source file; it only
+   grows to hold a longer line when echoing source */
+#define BUFLEN 65536
 
-static char lineBuf[BUFLEN]; /* holds the current line */
-static int linepos = 0; /* current position in LineBuf */
-static int bufsize = 0; /* current size of buffer string */
+static char * inBuf = NULL; /* holds a block of the source */
+static int bufcap = 0; /* allocated size of inBuf */
+static int bufpos = 0; /* current position in inBuf */
+static int bufsize = 0; /* number of characters in inBuf */
+static int atLineStart = TRUE; /* next character begins a line */
 static int EOF_flag = FALSE; /* corrects ungetNextChar behavior on EOF */
 
-/* getNextChar fetches the next non-blank character
-   from lineBuf, reading in a new line if lineBuf is
-   exhausted */
+/* fillBuf reads the next block of the source into
+   inBuf after the unread characters, keeping the
+   last character read for ungetNextChar; it returns
+   the number of characters read */
+static int fillBuf(void)
+{ int keep = (bufpos > 0) ? 1 : 0;
+  int n;
+  if (inBuf == NULL)
+  { bufcap = BUFLEN;
+    inBuf = (char *) malloc(bufcap);
+  }
+  else
+  { memmove(inBuf, inBuf + bufpos - keep, bufsize - bufpos + keep);
+    bufsize = bufsize - bufpos + keep;
+    bufpos = keep;
+    if (bufsize == bufcap)
+    { bufcap *= 2;
+      inBuf = (char *) realloc(inBuf, bufcap);
+    }
+  }
+  if (inBuf == NULL)
+  { fprintf(listing,"Out of memory error at line %d\n",lineno);
+    exit(1);
+  }
+  n = fread(inBuf + bufsize, 1, bufcap - bufsize, source);
+  bufsize += n;
+  return n;
+}
+
+/* echoLine prints the source line starting at
+   bufpos, first reading it into inBuf completely */
+static void echoLine(void)
+{ char * end;
+  while (((end = memchr(inBuf + bufpos, '\n', bufsize - bufpos)) == NULL)
+         && (fillBuf() > 0))
+    ;
+  fprintf(listing,"%4d: ",lineno);
+  if (end == NULL)
+  { fwrite(inBuf + bufpos, 1, bufsize - bufpos, listing);
+    fputc('\n', listing);
+  }
+  else
+    fwrite(inBuf + bufpos, 1, end - (inBuf + bufpos) + 1, listing);
+}
+
+/* getNextChar fetches the next character from
+   inBuf, reading in a new block if inBuf is
+   exhausted; lineno counts the lines begun */
 static int getNextChar(void)
-{ if (!(linepos < bufsize))
+{ int c;
+  if ((bufpos >= bufsize) && (fillBuf() == 0))
   { lineno++;
-    if (fgets(lineBuf,BUFLEN-1,source))
-    { if (EchoSource) fprintf(listing,"%4d: %s",lineno,lineBuf);
-      bufsize = strlen(lineBuf);
-      linepos = 0;
-      return lineBuf[linepos++];
-    }
-    else
-    { EOF_flag = TRUE;
-      return EOF;
-    }
+    atLineStart = FALSE;
+    EOF_flag = TRUE;
+    return EOF;
   }
-  else return lineBuf[linepos++];
+  if (atLineStart)
+  { lineno++;
+    atLineStart = FALSE;
+    if (EchoSource) echoLine();
+  }
+  c = (unsigned char) inBuf[bufpos++];
+  if (c == '\n') atLineStart = TRUE;
+  return c;
 }
 
 /* ungetNextChar backtracks one character
-   in lineBuf */
+   in inBuf */
 static void ungetNextChar(void)
-{ if (!EOF_flag) linepos-- ;}
-
-/* lookup table of reserved words */
-static struct
-    { char* str;
-      TokenType tok;
-    } reservedWords[MAXRESERVED]= 
-    {
-      // pj1
-      {"if",IF},
-      {"else",ELSE},
-      {"while",WHILE},
-      {"return",RETURN},
-      {"int",INT},
-      {"void",VOID}
-    };
+{ if (!EOF_flag)
+  { bufpos--;
+    if (inBuf[bufpos] == '\n') atLineStart = FALSE;
+  }
+}
 
-/* lookup an identifier to see if it is a reserved word */
-/* uses linear search */
-static TokenType reservedLookup (char * s)
-{ int i;
-  for (i=0;i<MAXRESERVED;i++)
-    if (!strcmp(s,reservedWords[i].str))
-      return reservedWords[i].tok;
+/* lookup an identifier s of length len to see if
+   it is a reserved word */
+/* switches on the length and the first character,
+   so that at most one reserved word is compared */
+static TokenType reservedLookup (char * s, int len)
+{ switch (len)
+  { // pj1
+    case 2:
+      if (!strcmp(s,"if")) return IF;
+      break;
+    case 3:
+      if (!strcmp(s,"int")) return INT;
+      break;
+    case 4:
+      if ((s[0] == 'e') && !strcmp(s,"else")) return ELSE;
+      if ((s[0] == 'v') && !strcmp(s,"void")) return VOID;
+      break;
+    case 5:
+      if (!strcmp(s,"while")) return WHILE;
+      break;
+    case 6:
+      if (!strcmp(s,"return")) return RETURN;
+      break;
+  }
   return ID;
 }
 
@@ -100,7 +155,22 @@ TokenType getToken(void)
          if (isdigit(c))
            state = INNUM;
          else if (isalpha(c))
-           state = INID;
+         { /* fast path: take the rest of the identifier
+              straight from inBuf */
+           tokenString[tokenStringIndex++] = (char) c;
+           while ((bufpos < bufsize) && isalnum((unsigned char) inBuf[bufpos]))
+           { if (tokenStringIndex < MAXTOKENLEN)
+               tokenString[tokenStringIndex++] = inBuf[bufpos];
+             bufpos++;
+           }
+           save = FALSE;
+           if (bufpos < bufsize)
+           { state = DONE;
+             currentToken = ID;
+           }
+           else /* may go on in the next block */
+             state = INID;
+         }
         // pj1
          else if (c == '=')
           state = INEQ;
@@ -257,7 +327,7 @@ TokenType getToken(void)
          currentToken = ERROR;
          break;
      }
-     if ((save) && (tokenStringIndex <= MAXTOKENLEN))
+     if ((save) && (tokenStringIndex < MAXTOKENLEN))
      {
        tokenString[tokenStringIndex++] = (char) c;
      }
@@ -266,7 +336,7 @@ TokenType getToken(void)
       tokenString[tokenStringIndex] = '\0';
        if (currentToken == ID)
        {
-         currentToken = reservedLookup(tokenString);
+         currentToken = reservedLookup(tokenString,tokenStringIndex);
        }
      }
    }
@@ -0,0 +1,198 @@
+#!/bin/sh
+# File: run.sh
+# Code generation tests: each test_dir/*.cm is compiled in
+# every code generator mode and run on TM with its .in file
+# as input; the output must equal its .out file. The same
+# programs then check the TM engines and options. A program
+# with a .tree file must parse to that syntax tree; one
+# with a .sym file must list that symbol table and those
+# semantic errors; one without a .out file must be rejected.
+#
+# usage: sh Codegen_testcase/run.sh   (from loucomp_3)
+
+CMINUS=${CMINUS:-./cminus_semantic}
+TM=${TM:-./tm}
+DIR=$(dirname "$0")
+OUT=${TESTDIR:-test.d}
+
+failed=0
+
+# Procedure result reports the test named $2 as
+# passed if the status $1 is 0
+result() {
+  if [ "$1" -eq 0 ]; then
+    echo "ok     $2"
+  else
+    echo "FAILED $2"
+    failed=1
+  fi
+}
+
+mkdir -p "$OUT"
+for src in "$DIR"/*.cm; do
+  name=$(basename "$src" .cm)
+  input="$DIR/$name.in"
+  [ -f "$input" ] || input=/dev/null
+  t="$OUT/$name"
+  cp "$src" "$t.cm"
+  if [ -f "$DIR/$name.tree" ]; then
+    $CMINUS -stop parse -trace parse "$t.cm" | sed 1,2d > "$t.tree"
+    cmp -s "$t.tree" "$DIR/$name.tree"
+    result $? "$name syntax tree"
+  fi
+  if [ -f "$DIR/$name.sym" ]; then
+    $CMINUS -stop analyze -trace analyze "$t.cm" | sed 1,2d > "$t.sym"
+    cmp -s "$t.sym" "$DIR/$name.sym"
+    result $? "$name symbol table"
+  fi
+  if [ ! -f "$DIR/$name.out" ]; then
+    $CMINUS -check "$t.cm" > /dev/null
+    [ $? -eq 1 ]
+    result $? "$name rejected"
+    continue
+  fi
+  for mode in "" "-regalloc" "-peephole" "-fold" "-regalloc -peephole" \
+              "-fold -regalloc -peephole" "-binary -regalloc"; do
+    case "$mode" in *-binary*) obj="$t.tmo" ;; *) obj="$t.tm" ;; esac
+    $CMINUS -trace none $mode "$t.cm" > "$t.lst" \
+      && $TM -r "$obj" < "$input" > "$t.run" \
+      && cmp -s "$t.run" "$DIR/$name.out"
+    result $? "$name $mode"
+  done
+
+  # the peephole optimizer shortens the code
+  $CMINUS -trace none -peephole "$t.cm" > "$t.lst" \
+    && awk '/^Peephole optimization:/ { n++; if ($5 < $3) shorter++ }
+            END { exit !(n > 0 && shorter == n) }' "$t.lst"
+  result $? "$name -peephole shortens"
+
+  # the step and threaded engines give the same
+  # output and instruction count
+  $CMINUS -trace none "$t.cm" > "$t.lst"
+  for e in step threaded; do
+    $TM -r -p -e $e "$t.tm" < "$input" > "$t.$e" 2> "$t.$e.n"
+  done
+  cmp -s "$t.step" "$DIR/$name.out" && cmp -s "$t.threaded" "$DIR/$name.out" \
+    && cmp -s "$t.step.n" "$t.threaded.n"
+  result $? "$name tm -e step, -e threaded"
+
+  # text to object and back gives the same object,
+  # which runs like the text
+  $TM -b "$t.conv.tmo" "$t.tm" > /dev/null \
+    && $TM -t "$t.back.tm" "$t.conv.tmo" > /dev/null \
+    && $TM -b "$t.back.tmo" "$t.back.tm" > /dev/null \
+    && cmp -s "$t.conv.tmo" "$t.back.tmo" \
+    && $TM -r "$t.conv.tmo" < "$input" > "$t.run" \
+    && cmp -s "$t.run" "$DIR/$name.out"
+  result $? "$name tm -b, -t round trip"
+
+  # the memories can be sized on the command line;
+  # a program larger than -i is refused
+  $TM -r -i 65536 -d 65536 "$t.tm" < "$input" > "$t.run" \
+    && cmp -s "$t.run" "$DIR/$name.out" \
+    && $TM -r -d 200 "$t.conv.tmo" < "$input" > "$t.run" \
+    && cmp -s "$t.run" "$DIR/$name.out"
+  result $? "$name tm -i, -d"
+  $TM -r -i 16 "$t.tm" < /dev/null | grep -q "Location too large" \
+    && $TM -r -i 16 "$t.conv.tmo" < /dev/null | grep -q "does not fit"
+  result $? "$name tm -i too small"
+
+  # batch mode reads IN from -in and writes OUT to
+  # -out; running out of input stops with status 5
+  rm -f "$t.run"
+  $TM -in "$input" -out "$t.run" "$t.tm" > /dev/null \
+    && cmp -s "$t.run" "$DIR/$name.out"
+  result $? "$name tm -in, -out"
+  if [ -s "$input" ]; then
+    $TM -in /dev/null -out /dev/null "$t.tm" > /dev/null
+    [ $? -eq 5 ]
+    result $? "$name tm input exhausted"
+  fi
+
+  # the profile counts every executed instruction and
+  # tags code with the constructs traced by -trace code
+  $CMINUS -trace code "$t.cm" > "$t.lst" \
+    && $TM -r -p -P -prof "$t.prof" "$t.tm" < "$input" > "$t.run" 2> "$t.n" \
+    && cmp -s "$t.run" "$DIR/$name.out" \
+    && [ "$(awk -F'\t' 'NR > 1 { n += $6 } END { print n }' "$t.prof")" \
+         = "$(sed -n 's/^Number of instructions executed = //p' "$t.n")" ] \
+    && awk -F'\t' '$8 == "function main"' "$t.prof" | grep -q .
+  result $? "$name tm -P -prof"
+
+  # superinstructions change neither the output nor
+  # the instruction count
+  $TM -r -p -O "$t.tm" < "$input" > "$t.run" 2> "$t.n" \
+    && cmp -s "$t.run" "$DIR/$name.out" \
+    && grep -q "^Fused [1-9]" "$t.n" \
+    && grep "^Number" "$t.n" | cmp -s - "$t.step.n"
+  result $? "$name tm -O"
+done
+
+# an object file one word short or one record long
+# is rejected
+size=$(wc -c < "$t.conv.tmo")
+head -c $((size - 4)) "$t.conv.tmo" > "$OUT/short.tmo"
+cat "$t.conv.tmo" "$OUT/short.tmo" | head -c $((size + 16)) > "$OUT/long.tmo"
+for obj in short long; do
+  $TM -r "$OUT/$obj.tmo" < /dev/null > "$OUT/$obj.run"
+  [ $? -eq 1 ] && grep -q "Bad object file size" "$OUT/$obj.run"
+  result $? "tm rejects $obj.tmo"
+done
+
+# -stop ends the compile after a phase, writing no code
+# before the code phase; -trace picks the listings, and
+# -trace code comments the code with its constructs
+t="$OUT/order"
+rm -f "$t.tm"
+$CMINUS -stop scan -trace scan,parse "$t.cm" > "$t.lst" \
+  && grep -q "reserved word: int" "$t.lst" \
+  && ! grep -q "^Syntax tree:" "$t.lst" \
+  && $CMINUS -stop parse -trace parse "$t.cm" > "$t.lst" \
+  && grep -q "^Syntax tree:" "$t.lst" \
+  && ! grep -q "reserved word" "$t.lst" \
+  && $CMINUS -check "$t.cm" > "$t.lst" \
+  && [ "$(wc -l < "$t.lst")" -eq 2 ] \
+  && [ ! -f "$t.tm" ] \
+  && $CMINUS -trace none "$t.cm" > /dev/null \
+  && ! grep -q "^\* ->" "$t.tm" \
+  && $CMINUS -trace code "$t.cm" > /dev/null \
+  && grep -q "^\* -> function main" "$t.tm"
+result $? "cminus -stop, -trace"
+$CMINUS -trace bogus "$t.cm" 2> /dev/null
+[ $? -eq 1 ]
+result $? "cminus -trace bogus"
+
+# the time report counts every token the scanner lists
+# and every instruction in the code, in both formats
+$CMINUS -trace none --time-report "$t.cm" > "$t.lst" \
+  && [ "$(awk '$1 == "total" { print $7, $11 }' "$t.lst")" \
+       = "$($CMINUS -stop scan -trace scan "$t.cm" | grep -c '^	[0-9]*: ') \
+$(grep -vc '^\*' "$t.tm")" ] \
+  && $CMINUS -trace none --time-report=json "$t.cm" > "$t.lst" \
+  && grep -q '{"phase": "total", .*"arena_allocs": [1-9]' "$t.lst"
+result $? "cminus --time-report"
+
+# a batch compiled on two threads gives each file the
+# code and listing of compiling it alone; a name without
+# an extension gets .tny, and a file with errors fails
+# the batch
+b="$OUT/batch"
+mkdir -p "$b"
+cp "$DIR/order.cm" "$DIR/fold.cm" "$b"
+cp "$DIR/lists.cm" "$b/lists.tny"
+ok=0
+for name in order.cm fold.cm lists.tny; do
+  $CMINUS -fold "$b/$name" > "$b/$name.lst" \
+    && mv "$b/${name%.*}.tm" "$b/$name.tm" || ok=1
+done
+$CMINUS -fold -j 2 "$b/order.cm" "$b/fold.cm" "$b/lists" > /dev/null || ok=1
+for name in order.cm fold.cm lists.tny; do
+  cmp -s "$b/${name%.*}.tm" "$b/$name.tm" \
+    && cmp -s "$b/${name%.*}.lst" "$b/$name.lst" || ok=1
+done
+result $ok "cminus -j 2"
+cp "$DIR/badcall.cm" "$b"
+$CMINUS -j 2 "$b/order.cm" "$b/badcall.cm" > /dev/null
+[ $? -eq 1 ]
+result $? "cminus -j 2 with errors"
+exit $failed
@@ -8,12 +8,16 @@
 
 #include "globals.h"
 #include "symtab.h"
+#include "util.h"
 #include "analyze.h"
 
 /* counter for variable memory locations */
 // scope 마다 다른 location var을 가져야됨.
 // static int location = 0;
-static ScopeList global_scope=NULL;
+static THREADLOCAL ScopeList global_scope=NULL;
+
+/* the function whose body is being analyzed */
+static THREADLOCAL TreeNode * currFunc=NULL;
 
 // pj3
 void init_scopeList()
@@ -22,22 +26,24 @@ void init_scopeList()
 
   // Built-in Functions
   // int input(void)
-  TreeNode *inputFunc = (TreeNode *)malloc(sizeof(TreeNode));
-  inputFunc->attr.name = "input";
+  TreeNode *inputFunc = newDeclNode(FuncDK);
+  inputFunc->attr.name = internString("input");
   inputFunc->type = Integer; 
   inputFunc->kind.decl = FuncDK;
   inputFunc->lineno = 0;
 
   st_insert(inputFunc, NULL); 
 
-  TreeNode *outputFunc = (TreeNode *)malloc(sizeof(TreeNode));
-  outputFunc->attr.name = "output";
+  TreeNode *outputFunc = newDeclNode(FuncDK);
+  outputFunc->attr.name = internString("output");
   outputFunc->type = Void; 
   outputFunc->kind.decl = FuncDK;
   outputFunc->lineno = 0;
-  TreeNode *outputParam = (TreeNode*)malloc(sizeof(TreeNode));
+  TreeNode *outputParam = newExpNode(ParamK);
   outputParam->type = Integer;
-  outputParam->attr.name = "value";
+  outputParam->attr.name = internString("value");
+  outputParam->lineno = 0;
+  outputFunc->child[0] = outputParam;
 
   st_insert(outputFunc, NULL);
   insert_scope(outputFunc->attr.name);
@@ -65,13 +71,16 @@ static void traverse( TreeNode * t,
   }
 }
 
-/* nullProc is a do-nothing procedure to 
- * generate preorder-only or postorder-only
- * traversals from traverse
+/* Procedure updateFrame grows the frame of the
+ * current function to cover local declaration t
  */
-static void nullProc(TreeNode * t)
-{ if (t==NULL) return;
-  else return;
+static void updateFrame(TreeNode * t)
+{
+  int words = 1;
+  if ((t->nodekind == DeclK) && (t->child[0] != NULL))
+    words = t->child[0]->attr.val;
+  if (t->memloc + words > currFunc->size)
+    currFunc->size = t->memloc + words;
 }
 
 /* Procedure insertNode inserts 
@@ -80,7 +89,7 @@ static void nullProc(TreeNode * t)
  */
 static void insertNode( TreeNode * t)
 { 
-  static int isFirstCompound = FALSE;
+  static THREADLOCAL int isFirstCompound = FALSE;
   switch (t->nodekind)
   { 
     case DeclK:
@@ -98,6 +107,8 @@ static void insertNode( TreeNode * t)
               t->type = Undet;
             }
             st_insert(t, NULL);
+            if ((t->level > 0) && (currFunc != NULL))
+              updateFrame(t);
           }
           else
             print_error(t->attr.name, t->lineno, 10);
@@ -110,6 +121,8 @@ static void insertNode( TreeNode * t)
             st_insert(t, NULL);
             insert_scope(t->attr.name);
             isFirstCompound = TRUE;
+            currFunc = t;
+            t->size = 0;
 
             // // Insert parameters
             // for(int i = 0; i < MAXCHILDREN; i++)
@@ -132,13 +145,7 @@ static void insertNode( TreeNode * t)
     case StmtK:
       switch (t->kind.stmt)
       { 
-        case IfK: 
-        case IfElseK:
-        case WhileK:
-          // fprintf(listing,"IFWHILE\n");
-          insert_scope(NULL);
-          isFirstCompound = TRUE;
-          break;
+        // if/while bodies that are compound open their own scope
         case ReturnK: 
           // fprintf(listing,"return\n");
           // exitScope();
@@ -182,10 +189,10 @@ static void insertNode( TreeNode * t)
           if(found_scope == NULL) /* undetermined variable */
           {
             print_error(t->attr.name, t->lineno, 1);
-            t->kind.decl = VarDK;
             t->type = Undet;
           }
-          st_insert(t, found_scope);
+          t->decl = st_insert(t, found_scope);
+          t->type = t->decl->type;
           break;
         case CallK:
           // fprintf(listing,"Call\n");
@@ -194,15 +201,16 @@ static void insertNode( TreeNode * t)
           if(found_scope == NULL) /* undetermined Function */
           {
             print_error(t->attr.name, t->lineno, 0);
-            t->kind.decl = FuncDK;
             t->type = Undet;
-            st_insert(t, found_scope);
+            t->decl = st_insert(t, found_scope);
             insert_scope(t->attr.name);
 
-            TreeNode *undet_param = (TreeNode*) malloc(sizeof(TreeNode));
+            TreeNode *undet_param = newExpNode(ParamK);
             undet_param->type = Undet;
-            undet_param->attr.name = "Undet";
+            undet_param->attr.name = internString("Undet");
+            undet_param->lineno = t->lineno;
             insert_param(undet_param, NULL);
+            exitScope();
           }
           else  /* function call */
           {
@@ -221,14 +229,19 @@ static void insertNode( TreeNode * t)
             //     }
             //   }
             // }
-            st_insert(t, found_scope);
+            t->decl = st_insert(t, found_scope);
+            t->type = t->decl->type;
           }
           break;
         case ParamK:
           // fprintf(listing,"Param\n");
           if (t->type != Void)
+          {
             if(insert_param(t, NULL) <0)
               print_error(t->attr.name, t->lineno, 10);
+            else if (currFunc != NULL)
+              updateFrame(t);
+          }
           break;
         // case IdK:
         //   if (st_lookup(t->attr.name) == -1)
@@ -248,10 +261,12 @@ static void insertNode( TreeNode * t)
   }
 }
 
+/* Procedure postProcessNode leaves the scope of a
+ * compound statement; a function body is the
+ * compound that closes the function's scope
+ */
 static void postProcessNode(TreeNode *t)
 {
-  if(t->nodekind == DeclK && t->kind.decl == FuncDK)
-    exitScope();
   if(t->nodekind == StmtK && t->kind.stmt == CompoundK)
     exitScope();
 }
@@ -312,7 +327,7 @@ static void print_error(char *name, int lineno, int errorNo)
     default:
       break;
   }
-  Error = TRUE;
+  Error++;
 }
 
 /* Procedure checkNode performs
@@ -320,34 +335,21 @@ static void print_error(char *name, int lineno, int errorNo)
  */
 static void checkNode(TreeNode * t)
 { 
-  static ExpType return_type = -1;
   switch (t->nodekind)
   {
-    case DeclK:
-      switch (t->kind.decl)
-      {
-      case FuncDK:
-        // return_type = t->type;
-        if(t->type != return_type)
-        {
-          print_error(t->attr.name, t->lineno, 6);
-          t->type = Undet;
-        }
-        break;
-      
-      default:
-        break;
-      }
-      break;
     case ExpK:
       switch (t->kind.exp)
       { 
         case AssignK:
-          if(t->child[0]->type != t->child[1]->type)
+          if((t->child[0]->type == Undet) || (t->child[1]->type == Undet))
+            t->type = Undet;  /* already reported */
+          else if(t->child[0]->type != t->child[1]->type)
           {
             print_error(t->attr.name, t->lineno, 7);
             t->type = Undet;
           }
+          else
+            t->type = t->child[0]->type;
           break;
         case OpK:
           // if((t->child[0] == NULL) || (t->child[1] == NULL))
@@ -370,11 +372,15 @@ static void checkNode(TreeNode * t)
           // index must be Integer type
           if(t->type == VoidArr || t->type == IntArr) /* Array type */
           {
+            if(t->child[0] == NULL) /* whole array, e.g. an argument */
+              break;
             if(t->child[0]->type != Integer)
             {
               print_error(t->attr.name, t->lineno, 3);
               t->type = Undet;
             }
+            else
+              t->type = Integer;
           }
           else  /* Non-Array type */
           {
@@ -386,24 +392,32 @@ static void checkNode(TreeNode * t)
           }
           break;
         case CallK:
-          ScopeList found_scope = st_lookup_down(t->attr.name, global_scope);
-          if(found_scope != NULL)
+          // arguments are the siblings of child[0]
           {
-            TreeNode *child;
-            ExpType arg_type;
-            for(int i = 0; i < MAXCHILDREN; i++)
+            TreeNode *child = t->child[0];
+            ExpType *param_types;
+            int param_cnt = st_lookup_params(t->attr.name, &param_types);
+            int i = 0;
+            if (param_cnt < 0) /* not a global function */
             {
-              if((child = t->child[i]) != NULL)
+              /* an undeclared function is already reported */
+              if (t->type != Undet)
               {
-                arg_type = get_argType(found_scope, i);
-                if((arg_type < 0) || (arg_type != child->type))
-                {
-                  fprintf(listing,"arg:%d, param:%d\n", arg_type, child->type);
-                  print_error(t->attr.name, t->lineno, 5);
-                  t->type = Undet;
-                  break;
-                }
+                print_error(t->attr.name, t->lineno, 5);
+                t->type = Undet;
               }
+              break;
+            }
+            while ((child != NULL) && (i < param_cnt)
+                   && (child->type == param_types[i]))
+            {
+              child = child->sibling;
+              i++;
+            }
+            if((child != NULL) || (i < param_cnt))
+            {
+              print_error(t->attr.name, t->lineno, 5);
+              t->type = Undet;
             }
           }
           break;
@@ -422,20 +436,12 @@ static void checkNode(TreeNode * t)
           break;
         case ReturnK:
           TreeNode *child;
+          ExpType return_type = Void;
           if((child = t->child[0]) != NULL)
-          {
             return_type = child->type;
-            // if(child->type != return_type)
-            //   print_error(t->attr.name, t->lineno, 6);
-          }
-          else
-          {
-            return_type = Void;
-            // if(return_type != Void)
-            //   print_error(t->attr.name, t->lineno, 6);
-          }
-
-          // return_type = -1;
+          if((currFunc != NULL) && (return_type != Undet)
+             && (return_type != currFunc->type))
+            print_error(t->attr.name, t->lineno, 6);
           break;
         default:
           break;
@@ -447,10 +453,20 @@ static void checkNode(TreeNode * t)
   }
 }
 
+/* Procedure enterFunc records the function whose
+ * returns checkNode is about to check
+ */
+static void enterFunc(TreeNode * t)
+{
+  if(t->nodekind == DeclK && t->kind.decl == FuncDK)
+    currFunc = t;
+}
+
 /* Procedure typeCheck performs type checking 
  * by a postorder syntax tree traversal
  * AST의 아래에서 위로 type checking
  */
 void typeCheck(TreeNode * syntaxTree)
-{ traverse(syntaxTree,nullProc,checkNode);
+{ currFunc = NULL;
+  traverse(syntaxTree,enterFunc,checkNode);
 }
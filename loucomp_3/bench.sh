@@ -0,0 +1,52 @@
+#!/bin/sh
+# File: bench.sh
+# Benchmark of the C-MINUS compiler and the TM simulator
+# on synthetic programs made by cmgen.
+#
+# usage: sh bench.sh [-x v1 v2 ...]
+#
+# Sweeps the cmgen option -x over the values given
+# (default: -f 100 200 400 800 1600), keeping the other
+# options in $GENOPTS. For each program it prints the
+# wall time of every compiler phase (from --time-report),
+# the time of running it on TM, and the throughput in
+# lines and nodes per second. The ns/line column of a
+# phase stays flat while the phase scales linearly;
+# a column that grows with the size is superlinear.
+
+CMINUS=${CMINUS:-./cminus_semantic}
+TM=${TM:-./tm}
+CMGEN=${CMGEN:-./cmgen}
+DIR=${BENCHDIR:-bench.d}
+
+if [ $# -eq 0 ]; then set -- -f 100 200 400 800 1600; fi
+OPT=$1
+shift
+
+mkdir -p "$DIR"
+printf '%-8s %8s %8s %8s %8s %8s %8s %8s %8s %10s %10s %8s %8s %8s %8s\n' \
+  "$OPT" lines parse symtab types codegen total tm \
+  instrs "lines/s" "nodes/s" "ns/ln P" "ns/ln S" "ns/ln T" "ns/ln C"
+for v in "$@"; do
+  src="$DIR/bench$v.cm"
+  $CMGEN $GENOPTS $OPT "$v" > "$src" || exit 1
+  lines=$(wc -l < "$src")
+  report=$($CMINUS -trace none --time-report "$src") || exit 1
+  start=$(date +%s%N)
+  if ! $TM -r "$DIR/bench$v.tm" < /dev/null > /dev/null; then
+    echo "bench.sh: $TM failed on $DIR/bench$v.tm" >&2
+    exit 1
+  fi
+  tm=$(( ($(date +%s%N) - start) / 1000000 ))
+  echo "$report" | awk -v v="$v" -v lines="$lines" -v tm="$tm" '
+    /^(parse|symtab|typecheck|codegen|total) / { ms[$1] = $2; nodes[$1] = $8; instrs[$1] = $11 }
+    END {
+      t = ms["total"] / 1000
+      ns = 1e6 / lines
+      printf "%-8s %8d %8.1f %8.1f %8.1f %8.1f %8.1f %8d %8d %10.0f %10.0f %8.0f %8.0f %8.0f %8.0f\n",
+        v, lines, ms["parse"], ms["symtab"], ms["typecheck"], ms["codegen"],
+        ms["total"], tm, instrs["total"],
+        (t > 0) ? lines / t : 0, (t > 0) ? nodes["total"] / t : 0,
+        ms["parse"] * ns, ms["symtab"] * ns, ms["typecheck"] * ns, ms["codegen"] * ns
+    }'
+done
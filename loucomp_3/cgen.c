@@ -1,7 +1,7 @@
 /****************************************************/
 /* File: cgen.c                                     */
 /* The code generator implementation                */
-/* for the TINY compiler                            */
+/* for the C-MINUS compiler                         */
 /* (generates code for the TM machine)              */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
@@ -12,83 +12,389 @@
 #include "code.h"
 #include "cgen.h"
 
+/* Run-time organization
+ *
+ * Globals live at gp+memloc, at the bottom of data
+ * memory. The stack grows down from the top. The
+ * activation record of a function with frame size F
+ * (words of parameters and locals) is
+ *       0(fp)        control link (caller's fp)
+ *      -1(fp)        return address
+ *   k-1-F(fp)        parameter or local word k
+ * where k is the symbol table memloc, so arrays
+ * grow upwards. mp points just below the record
+ * and temps are pushed at tmpOffset(mp).
+ * Arguments are stored directly into the callee's
+ * record; an array argument is the address of its
+ * element 0. Function results are returned in ac.
+ */
+
 /* tmpOffset is the memory offset for temps
    It is decremented each time a temp is
    stored, and incremeted when loaded again
 */
-static int tmpOffset = 0;
+static THREADLOCAL int tmpOffset = 0;
+
+/* frameSize is the size F of the activation
+ * record of the function being generated
+ */
+static THREADLOCAL int frameSize = 0;
 
 /* prototype for internal recursive code generator */
 static void cGen (TreeNode * tree);
+static void genExp( TreeNode * tree);
+
+/* registers that hold expression temporaries when
+ * RegAlloc is TRUE, in allocation order; ac comes
+ * first so that a result always ends up in ac.
+ * Register 4 is left for the frame pointer
+ */
+static int tempRegs[] = { ac, ac1, 2, 3 };
+#define NTEMPREGS ((int) (sizeof(tempRegs)/sizeof(tempRegs[0])))
+
+/* ALLREGS is the register need of nodes genReg
+ * cannot handle, such as calls: more than there
+ * are, so nothing is live in a register while
+ * they run
+ */
+#define ALLREGS 0x7fff
+
+/* Function isArrayParam returns TRUE if declaration
+ * decl is an array parameter, whose word holds the
+ * address of the array rather than the array
+ */
+static int isArrayParam( TreeNode * decl)
+{ return (decl->nodekind == ExpK) && (decl->kind.exp == ParamK)
+      && ((decl->type == IntArr) || (decl->type == VoidArr));
+} /* isArrayParam */
+
+/* Function isArray returns TRUE if declaration
+ * decl names an array
+ */
+static int isArray( TreeNode * decl)
+{ return (decl->type == IntArr) || (decl->type == VoidArr);
+} /* isArray */
+
+/* Procedure varBase gives the base register and
+ * offset of the variable declared by decl (of its
+ * element 0 for an array)
+ */
+static void varBase( TreeNode * decl, int * reg, int * offset)
+{ if (decl->level == 0)
+  { *reg = gp;
+    *offset = decl->memloc;
+  }
+  else
+  { *reg = fp;
+    *offset = decl->memloc - 1 - frameSize;
+  }
+} /* varBase */
+
+/* Function needRegs returns the Sethi-Ullman number
+ * of an expression: the registers needed to evaluate
+ * it without spilling
+ */
+static int needRegs( TreeNode * tree)
+{ int l, r;
+  if (tree == NULL) return 0;
+  if (tree->nodekind != ExpK) return ALLREGS;
+  switch (tree->kind.exp) {
+    case ConstK :
+      return 1;
+    case VarK :
+      if (tree->child[0] == NULL) return 1;
+      l = needRegs(tree->child[0]);
+      r = isArrayParam(tree->decl) ? 2 : 1;
+      return (l > r) ? l : r;
+    case OpK :
+      l = needRegs(tree->child[0]);
+      r = needRegs(tree->child[1]);
+      return (l == r) ? l + 1 : ((l > r) ? l : r);
+    default :
+      return ALLREGS;
+  }
+} /* needRegs */
+
+/* Function hasSideEffects returns TRUE if
+ * evaluating tree may call a function or assign,
+ * so that it must not be moved across another
+ * operand
+ */
+static int hasSideEffects( TreeNode * tree)
+{ int i;
+  if (tree == NULL) return FALSE;
+  if ((tree->nodekind == ExpK)
+      && ((tree->kind.exp == CallK) || (tree->kind.exp == AssignK)))
+    return TRUE;
+  for (i = 0; i < MAXCHILDREN; i++)
+    if (hasSideEffects(tree->child[i])) return TRUE;
+  return FALSE;
+} /* hasSideEffects */
+
+/* Procedure emitCompare emits code for r = a op b
+ * for the relational jump instruction jmp
+ */
+static void emitCompare( char * jmp, int r, int a, int b, char * c)
+{ emitRO("SUB",r,a,b,c) ;
+  emitRM(jmp,r,2,pc,"br if true") ;
+  emitRM("LDC",r,0,r,"false case") ;
+  emitRM("LDA",pc,1,pc,"unconditional jmp") ;
+  emitRM("LDC",r,1,r,"true case") ;
+} /* emitCompare */
+
+/* Procedure emitOp emits code for r = a op b */
+static void emitOp( TokenType op, int r, int a, int b)
+{ switch (op) {
+    case PLUS :  emitRO("ADD",r,a,b,"op +"); break;
+    case MINUS : emitRO("SUB",r,a,b,"op -"); break;
+    case TIMES : emitRO("MUL",r,a,b,"op *"); break;
+    case OVER :  emitRO("DIV",r,a,b,"op /"); break;
+    case LT :    emitCompare("JLT",r,a,b,"op <"); break;
+    case LE :    emitCompare("JLE",r,a,b,"op <="); break;
+    case GT :    emitCompare("JGT",r,a,b,"op >"); break;
+    case GE :    emitCompare("JGE",r,a,b,"op >="); break;
+    case EQ :    emitCompare("JEQ",r,a,b,"op =="); break;
+    case NE :    emitCompare("JNE",r,a,b,"op !="); break;
+    default:
+      emitComment("BUG: Unknown operator");
+      break;
+  }
+} /* emitOp */
+
+/* Procedure emitVar emits code for r = the value
+ * of variable tree, whose index (if any) has been
+ * evaluated into r already; t is a free register,
+ * needed only for array parameters
+ */
+static void emitVar( TreeNode * tree, int r, int t)
+{ TreeNode * decl = tree->decl;
+  int base, offset;
+  if (isArrayParam(decl))
+  { emitRM("LD",(tree->child[0] == NULL) ? r : t,
+           decl->memloc - 1 - frameSize,fp,"load array address");
+    if (tree->child[0] != NULL)
+    { emitRO("ADD",r,r,t,"add index");
+      emitRM("LD",r,0,r,"load array element");
+    }
+    return;
+  }
+  varBase(decl,&base,&offset);
+  if (tree->child[0] != NULL)
+  { emitRO("ADD",r,r,base,"add index");
+    emitRM("LD",r,offset,r,"load array element");
+  }
+  else if (isArray(decl))
+    emitRM("LDA",r,offset,base,"load array address");
+  else
+    emitRM("LD",r,offset,base,"load id value");
+} /* emitVar */
+
+/* Procedure genReg generates code that leaves the
+ * value of an expression in regs[0], using only the
+ * n registers in regs. The operand needing more
+ * registers is evaluated first, unless that would
+ * move a call or assignment across the other one;
+ * when the right operand then needs all n, the left
+ * one is spilled to the mp stack
+ */
+static void genReg( TreeNode * tree, int * regs, int n)
+{ int l, r, i, ordered;
+  int rest[NTEMPREGS];
+  TreeNode * p1, * p2;
+  switch (tree->kind.exp) {
+    case ConstK :
+      emitRM("LDC",regs[0],tree->attr.val,0,"load const");
+      break;
+
+    case VarK :
+      if (tree->child[0] != NULL)
+        genReg(tree->child[0],regs,n);
+      emitVar(tree,regs[0],(n > 1) ? regs[1] : ac1);
+      break;
+
+    case OpK :
+      p1 = tree->child[0];
+      p2 = tree->child[1];
+      l = needRegs(p1);
+      r = needRegs(p2);
+      /* operands with side effects are evaluated left
+         to right, as the accumulator code does */
+      ordered = hasSideEffects(p1) || hasSideEffects(p2);
+      if ((r >= n) && ((l >= n) || ordered))
+      { genReg(p1,regs,n);
+        emitRM("ST",regs[0],tmpOffset--,mp,"op: spill left");
+        genReg(p2,regs,n);
+        emitRM("LD",regs[1],++tmpOffset,mp,"op: reload left");
+        emitOp(tree->attr.op,regs[0],regs[1],regs[0]);
+        break;
+      }
+      else if ((l >= r) || ordered)
+      { genReg(p1,regs,n);
+        genReg(p2,regs+1,n-1);
+      }
+      else
+      { /* right into regs[1] first, then left into regs[0] */
+        rest[0] = regs[1];
+        rest[1] = regs[0];
+        for (i = 2; i < n; i++) rest[i] = regs[i];
+        genReg(p2,rest,n);
+        rest[0] = regs[0];
+        for (i = 2; i < n; i++) rest[i-1] = regs[i];
+        genReg(p1,rest,n-1);
+      }
+      emitOp(tree->attr.op,regs[0],regs[0],regs[1]);
+      break;
+
+    default :
+      /* nothing is live here: use the accumulator code */
+      genExp(tree);
+      if (regs[0] != ac) emitRM("LDA",regs[0],0,ac,"move to temp");
+      break;
+  }
+} /* genReg */
+
+/* Procedure genReturn emits the function return
+ * sequence; the result, if any, is in ac
+ */
+static void genReturn(void)
+{ emitRM("LD",ac1,-1,fp,"return: load return address");
+  emitRM("LD",fp,0,fp,"return: pop frame");
+  emitRM("LDA",pc,0,ac1,"return: jump back");
+} /* genReturn */
+
+/* Procedure genCall generates code for a call;
+ * input and output are expanded inline
+ */
+static void genCall( TreeNode * tree)
+{ TreeNode * func = tree->decl;
+  TreeNode * arg;
+  int base, calleeSize, i;
+  if (strcmp(tree->attr.name,"input") == 0)
+  { emitRO("IN",ac,0,0,"input integer value");
+    return;
+  }
+  if (strcmp(tree->attr.name,"output") == 0)
+  { genExp(tree->child[0]);
+    emitRO("OUT",ac,0,0,"output ac");
+    return;
+  }
+  /* the callee's record starts at the first free temp */
+  base = tmpOffset;
+  calleeSize = func->size;
+  tmpOffset -= calleeSize + 2;
+  for (arg = tree->child[0], i = 0; arg != NULL; arg = arg->sibling, i++)
+  { genExp(arg);
+    emitRM("ST",ac,base + i - 1 - calleeSize,mp,"call: store argument");
+  }
+  tmpOffset = base;
+  emitRM("ST",fp,base,mp,"call: store control link");
+  emitRM("LDA",fp,base,mp,"call: push frame");
+  emitRM("LDA",ac,2,pc,"call: return address");
+  emitRM("ST",ac,-1,fp,"call: store return address");
+  emitRM_Abs("LDA",pc,func->memloc,"call: jump to function");
+  emitRM("LDA",mp,-2-frameSize,fp,"call: restore mp");
+} /* genCall */
+
+/* Procedure genAssign generates code at an
+ * assignment node; its value is left in ac
+ */
+static void genAssign( TreeNode * tree)
+{ TreeNode * var = tree->child[0];
+  TreeNode * decl = var->decl;
+  int base, offset;
+  if (var->child[0] == NULL)
+  { genExp(tree->child[1]);
+    varBase(decl,&base,&offset);
+    emitRM("ST",ac,offset,base,"assign: store value");
+    return;
+  }
+  /* compute the element address and keep it as a temp */
+  genExp(var->child[0]);
+  if (isArrayParam(decl))
+  { emitRM("LD",ac1,decl->memloc - 1 - frameSize,fp,"load array address");
+    emitRO("ADD",ac,ac,ac1,"add index");
+    offset = 0;
+  }
+  else
+  { varBase(decl,&base,&offset);
+    emitRO("ADD",ac,ac,base,"add index");
+  }
+  emitRM("ST",ac,tmpOffset--,mp,"assign: push address");
+  genExp(tree->child[1]);
+  emitRM("LD",ac1,++tmpOffset,mp,"assign: load address");
+  emitRM("ST",ac,offset,ac1,"assign: store value");
+} /* genAssign */
 
 /* Procedure genStmt generates code at a statement node */
 static void genStmt( TreeNode * tree)
 { TreeNode * p1, * p2, * p3;
   int savedLoc1,savedLoc2,currentLoc;
-  int loc;
   switch (tree->kind.stmt) {
 
       case IfK :
+      case IfElseK :
          if (TraceCode) emitComment("-> if") ;
          p1 = tree->child[0] ;
          p2 = tree->child[1] ;
          p3 = tree->child[2] ;
          /* generate code for test expression */
-         cGen(p1);
+         genExp(p1);
          savedLoc1 = emitSkip(1) ;
          emitComment("if: jump to else belongs here");
          /* recurse on then part */
          cGen(p2);
-         savedLoc2 = emitSkip(1) ;
-         emitComment("if: jump to end belongs here");
+         if (p3 != NULL)
+         { savedLoc2 = emitSkip(1) ;
+           emitComment("if: jump to end belongs here");
+         }
          currentLoc = emitSkip(0) ;
          emitBackup(savedLoc1) ;
          emitRM_Abs("JEQ",ac,currentLoc,"if: jmp to else");
          emitRestore() ;
-         /* recurse on else part */
-         cGen(p3);
-         currentLoc = emitSkip(0) ;
-         emitBackup(savedLoc2) ;
-         emitRM_Abs("LDA",pc,currentLoc,"jmp to end") ;
-         emitRestore() ;
+         if (p3 != NULL)
+         { /* recurse on else part */
+           cGen(p3);
+           currentLoc = emitSkip(0) ;
+           emitBackup(savedLoc2) ;
+           emitRM_Abs("LDA",pc,currentLoc,"jmp to end") ;
+           emitRestore() ;
+         }
          if (TraceCode)  emitComment("<- if") ;
          break; /* if_k */
 
-      case RepeatK:
-         if (TraceCode) emitComment("-> repeat") ;
+      case WhileK:
+         if (TraceCode) emitComment("-> while") ;
          p1 = tree->child[0] ;
          p2 = tree->child[1] ;
          savedLoc1 = emitSkip(0);
-         emitComment("repeat: jump after body comes back here");
-         /* generate code for body */
-         cGen(p1);
+         emitComment("while: jump after body comes back here");
          /* generate code for test */
+         genExp(p1);
+         savedLoc2 = emitSkip(1) ;
+         emitComment("while: jump to end belongs here");
+         /* generate code for body */
          cGen(p2);
-         emitRM_Abs("JEQ",ac,savedLoc1,"repeat: jmp back to body");
-         if (TraceCode)  emitComment("<- repeat") ;
-         break; /* repeat */
-
-      case AssignK:
-         if (TraceCode) emitComment("-> assign") ;
-         /* generate code for rhs */
-         cGen(tree->child[0]);
-         /* now store value */
-         loc = st_lookup(tree->attr.name);
-         emitRM("ST",ac,loc,gp,"assign: store value");
-         if (TraceCode)  emitComment("<- assign") ;
-         break; /* assign_k */
-
-      case ReadK:
-         emitRO("IN",ac,0,0,"read integer value");
-         loc = st_lookup(tree->attr.name);
-         emitRM("ST",ac,loc,gp,"read: store value");
+         emitRM_Abs("LDA",pc,savedLoc1,"while: jmp back to test");
+         currentLoc = emitSkip(0) ;
+         emitBackup(savedLoc2) ;
+         emitRM_Abs("JEQ",ac,currentLoc,"while: jmp to end");
+         emitRestore() ;
+         if (TraceCode)  emitComment("<- while") ;
+         break; /* while */
+
+      case ReturnK:
+         if (TraceCode) emitComment("-> return") ;
+         if (tree->child[0] != NULL)
+           genExp(tree->child[0]);
+         genReturn();
+         if (TraceCode)  emitComment("<- return") ;
          break;
-      case WriteK:
-         /* generate code for expression to write */
-         cGen(tree->child[0]);
-         /* now output it */
-         emitRO("OUT",ac,0,0,"write ac");
+
+      case CompoundK:
+         /* declarations (child[0]) need no code */
+         cGen(tree->child[1]);
          break;
+
       default:
          break;
     }
@@ -96,8 +402,7 @@ static void genStmt( TreeNode * tree)
 
 /* Procedure genExp generates code at an expression node */
 static void genExp( TreeNode * tree)
-{ int loc;
-  TreeNode * p1, * p2;
+{ TreeNode * p1, * p2;
   switch (tree->kind.exp) {
 
     case ConstK :
@@ -106,71 +411,80 @@ static void genExp( TreeNode * tree)
       emitRM("LDC",ac,tree->attr.val,0,"load const");
       if (TraceCode)  emitComment("<- Const") ;
       break; /* ConstK */
-    
-    case IdK :
-      if (TraceCode) emitComment("-> Id") ;
-      loc = st_lookup(tree->attr.name);
-      emitRM("LD",ac,loc,gp,"load id value");
-      if (TraceCode)  emitComment("<- Id") ;
-      break; /* IdK */
+
+    case VarK :
+      if (TraceCode) emitComment("-> Var") ;
+      if (tree->child[0] != NULL)
+        genExp(tree->child[0]);
+      emitVar(tree,ac,ac1);
+      if (TraceCode)  emitComment("<- Var") ;
+      break; /* VarK */
 
     case OpK :
          if (TraceCode) emitComment("-> Op") ;
+         if (RegAlloc)
+         { genReg(tree,tempRegs,NTEMPREGS);
+           if (TraceCode)  emitComment("<- Op") ;
+           break;
+         }
          p1 = tree->child[0];
          p2 = tree->child[1];
          /* gen code for ac = left arg */
-         cGen(p1);
+         genExp(p1);
          /* gen code to push left operand */
          emitRM("ST",ac,tmpOffset--,mp,"op: push left");
          /* gen code for ac = right operand */
-         cGen(p2);
+         genExp(p2);
          /* now load left operand */
          emitRM("LD",ac1,++tmpOffset,mp,"op: load left");
-         switch (tree->attr.op) {
-            case PLUS :
-               emitRO("ADD",ac,ac1,ac,"op +");
-               break;
-            case MINUS :
-               emitRO("SUB",ac,ac1,ac,"op -");
-               break;
-            case TIMES :
-               emitRO("MUL",ac,ac1,ac,"op *");
-               break;
-            case OVER :
-               emitRO("DIV",ac,ac1,ac,"op /");
-               break;
-            case LT :
-               emitRO("SUB",ac,ac1,ac,"op <") ;
-               emitRM("JLT",ac,2,pc,"br if true") ;
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
-            case EQ :
-               emitRO("SUB",ac,ac1,ac,"op ==") ;
-               emitRM("JEQ",ac,2,pc,"br if true");
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
-            default:
-               emitComment("BUG: Unknown operator");
-               break;
-         } /* case op */
+         emitOp(tree->attr.op,ac,ac1,ac);
          if (TraceCode)  emitComment("<- Op") ;
          break; /* OpK */
 
+    case AssignK :
+      if (TraceCode) emitComment("-> assign") ;
+      genAssign(tree);
+      if (TraceCode)  emitComment("<- assign") ;
+      break; /* AssignK */
+
+    case CallK :
+      if (TraceCode) emitComment("-> call") ;
+      genCall(tree);
+      if (TraceCode)  emitComment("<- call") ;
+      break; /* CallK */
+
     default:
       break;
   }
 } /* genExp */
 
+/* Procedure genDecl generates code at a declaration
+ * node; only function bodies need code
+ */
+static void genDecl( TreeNode * tree)
+{ char buffer[128];
+  if (tree->kind.decl != FuncDK) return;
+  tree->memloc = emitSkip(0);
+  frameSize = tree->size;
+  tmpOffset = 0;
+  snprintf(buffer,sizeof(buffer),"-> function %s",tree->attr.name);
+  if (TraceCode) emitComment(buffer) ;
+  emitRM("LDA",mp,-2-frameSize,fp,"function: set mp below frame");
+  cGen(tree->child[1]);
+  /* falling off the end returns */
+  genReturn();
+  if (TraceCode)  emitComment("<- function") ;
+} /* genDecl */
+
 /* Procedure cGen recursively generates code by
  * tree traversal
  */
 static void cGen( TreeNode * tree)
 { if (tree != NULL)
   { switch (tree->nodekind) {
+      case DeclK:
+        genDecl(tree);
+        break;
       case StmtK:
         genStmt(tree);
         break;
@@ -195,18 +509,47 @@ static void cGen( TreeNode * tree)
  */
 void codeGen(TreeNode * syntaxTree, char * codefile)
 {  char * s = malloc(strlen(codefile)+7);
+   TreeNode * t, * mainFunc = NULL;
+   int savedLoc, currentLoc;
    strcpy(s,"File: ");
    strcat(s,codefile);
-   emitComment("TINY Compilation to TM Code");
+   emitComment("C-MINUS Compilation to TM Code");
    emitComment(s);
    /* generate standard prelude */
    emitComment("Standard prelude:");
    emitRM("LD",mp,0,ac,"load maxaddress from location 0");
    emitRM("ST",ac,0,ac,"clear location 0");
+   savedLoc = emitSkip(1);
    emitComment("End of standard prelude.");
-   /* generate code for TINY program */
+   /* generate code for C-MINUS functions */
    cGen(syntaxTree);
+   for (t = syntaxTree; t != NULL; t = t->sibling)
+     if ((t->nodekind == DeclK) && (t->kind.decl == FuncDK)
+         && (strcmp(t->attr.name,"main") == 0))
+       mainFunc = t;
+   /* call main from a frame at the top of memory */
+   emitComment("Call main:");
+   currentLoc = emitSkip(0);
+   emitBackup(savedLoc);
+   emitRM_Abs("LDA",pc,currentLoc,"jump to call of main");
+   emitRestore();
+   emitRM("LDA",fp,0,mp,"fp = top of memory");
+   frameSize = 0;
+   tmpOffset = 0;
+   if (mainFunc != NULL)
+   { TreeNode call;
+     memset(&call,0,sizeof(call));
+     call.nodekind = ExpK;
+     call.kind.exp = CallK;
+     call.attr.name = "main";
+     call.decl = mainFunc;
+     genCall(&call);
+   }
+   else
+     emitComment("BUG: no main function");
    /* finish */
    emitComment("End of execution.");
    emitRO("HALT",0,0,0,"");
+   emitEnd();
+   free(s);
 }
@@ -0,0 +1,432 @@
+/****************************************************/
+/* File: cmgen.c                                    */
+/* Generator of synthetic C-MINUS programs for      */
+/* benchmarking the compiler and the TM simulator   */
+/****************************************************/
+
+/* cmgen writes a valid C-MINUS program to standard
+ * output. Every program type checks and terminates:
+ * functions only call functions declared before
+ * them, each call spends one unit of the global
+ * fuel, loops count a private counter up to a
+ * small bound, array indices are constants within
+ * bounds, and there is no division. Every local is
+ * assigned before it is read, so the output does
+ * not depend on the optimizations used
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+/* the shape of the generated program, set by the
+ * command line options
+ */
+static int nFuncs = 10;     /* -f: functions besides main */
+static int nGlobals = 10;   /* -g: global variables */
+static int maxDepth = 2;    /* -d: nesting depth of if and while */
+static int nStmts = 5;      /* -s: statements in each block */
+static int idLen = 4;       /* -l: length of identifiers */
+static int arrayPct = 20;   /* -a: percent of variables that are arrays */
+static int callPct = 20;    /* -c: percent of operands that are calls */
+static int fuel = 1000;     /* -u: calls made before functions return early */
+
+/* MINARRAY = the least size of an array; array
+ * parameters are only indexed below it
+ */
+#define MINARRAY 4
+
+/* MAXEXPDEPTH = the nesting depth of expressions */
+#define MAXEXPDEPTH 3
+
+/* MAXPARAMS = the most parameters of a function */
+#define MAXPARAMS 3
+
+/* LOOPS = the iterations of every while loop */
+#define LOOPS 2
+
+/* a variable in scope; size is 0 for an int and
+ * the number of elements of an array, which is
+ * MINARRAY for an array parameter
+ */
+typedef struct
+   { char name[64];
+     int size;
+     int readOnly;   /* loop counters are never assigned */
+   } VarRec;
+
+/* a declared function */
+typedef struct
+   { char name[64];
+     int nParams;
+     int isArray[MAXPARAMS];
+   } FuncRec;
+
+static VarRec * vars = NULL;    /* the variables in scope, innermost last */
+static int varCount = 0, varMax = 0;
+static FuncRec * funcs = NULL;  /* the functions declared so far */
+static int funcCount = 0;
+static int nameCount = 0;       /* numbers the generated names */
+static int indent = 0;
+
+/* Function chance returns TRUE with percent
+ * probability pct
+ */
+static int chance(int pct)
+{ return (rand() % 100) < pct; }
+
+/* Procedure newName stores in name a new identifier
+ * of idLen characters: the letter prefix followed by
+ * a zero-padded number. No reserved word starts with
+ * the prefixes used
+ */
+static void newName(char * name, char prefix)
+{ int width = idLen - 1;
+  if (width < 1) width = 1;
+  if (width > 60) width = 60;
+  sprintf(name,"%c%0*d",prefix,width,nameCount++);
+}
+
+/* Procedure line starts a new indented line */
+static void line(void)
+{ int i;
+  for (i = 0; i < indent; i++) fputs("  ",stdout);
+}
+
+/* Function addVar adds a variable of the given size
+ * to the scope and returns it
+ */
+static VarRec * addVar(char prefix, int size)
+{ if (varCount == varMax)
+  { varMax = varMax ? 2 * varMax : 64;
+    vars = (VarRec *) realloc(vars, varMax * sizeof(VarRec));
+    if (vars == NULL)
+    { fprintf(stderr,"Out of memory\n");
+      exit(1);
+    }
+  }
+  newName(vars[varCount].name,prefix);
+  vars[varCount].size = size;
+  vars[varCount].readOnly = FALSE;
+  return &vars[varCount++];
+}
+
+/* Function arraySize returns the size of a new
+ * variable: 0 for an int, or an array size
+ */
+static int arraySize(void)
+{ return chance(arrayPct) ? MINARRAY + rand() % 13 : 0; }
+
+/* Function pickVar returns a random variable in
+ * scope that is an array if isArray, or NULL if
+ * there is none. Assignable variables only are
+ * returned if assign
+ */
+static VarRec * pickVar(int isArray, int assign)
+{ int i, n = 0;
+  VarRec * v = NULL;
+  for (i = 0; i < varCount; i++)
+    if (((vars[i].size > 0) == isArray) && !(assign && vars[i].readOnly))
+      if (rand() % ++n == 0) v = &vars[i];
+  return v;
+}
+
+static void genExp(int depth);
+
+/* Procedure genVar writes a use of the int or
+ * array variable v, indexing an array by a
+ * constant within its bounds
+ */
+static void genVar(VarRec * v)
+{ if (v->size == 0) fputs(v->name,stdout);
+  else printf("%s[%d]",v->name,rand() % v->size);
+}
+
+/* Procedure genCall writes a call of function f */
+static void genCall(FuncRec * f, int depth)
+{ int i;
+  printf("%s(",f->name);
+  for (i = 0; i < f->nParams; i++)
+  { if (i > 0) fputs(", ",stdout);
+    if (f->isArray[i]) fputs(pickVar(TRUE,FALSE)->name,stdout);
+    else genExp(depth + 1);
+  }
+  putchar(')');
+}
+
+/* Procedure genOperand writes a constant, variable
+ * or call
+ */
+static void genOperand(int depth)
+{ VarRec * v;
+  if ((funcCount > 0) && (depth < MAXEXPDEPTH) && chance(callPct))
+  { genCall(&funcs[rand() % funcCount],depth);
+    return;
+  }
+  v = pickVar(chance(arrayPct),FALSE);
+  if ((v == NULL) || chance(20)) printf("%d",rand() % 100);
+  else genVar(v);
+}
+
+/* Procedure genExp writes an int expression */
+static void genExp(int depth)
+{ static char * ops[] = {"+", "-", "*"};
+  if ((depth >= MAXEXPDEPTH) || chance(40)) genOperand(depth);
+  else
+  { int paren = chance(30);
+    if (paren) putchar('(');
+    genExp(depth + 1);
+    printf(" %s ",ops[rand() % 3]);
+    genExp(depth + 1);
+    if (paren) putchar(')');
+  }
+}
+
+/* Procedure genCond writes a comparison */
+static void genCond(void)
+{ static char * relops[] = {"<", "<=", ">", ">=", "==", "!="};
+  genExp(1);
+  printf(" %s ",relops[rand() % 6]);
+  genExp(1);
+}
+
+/* Procedure genLocals declares n locals of a block,
+ * adds them to the scope and initializes them; the
+ * first is an int if firstInt
+ */
+static void genLocals(int n, int firstInt)
+{ int i, j, first = varCount;
+  for (i = 0; i < n; i++)
+  { VarRec * v = addVar('l',((i == 0) && firstInt) ? 0 : arraySize());
+    line();
+    if (v->size == 0) printf("int %s;\n",v->name);
+    else printf("int %s[%d];\n",v->name,v->size);
+  }
+  for (i = first; i < varCount; i++)
+    if (vars[i].size == 0)
+    { line();
+      printf("%s = %d;\n",vars[i].name,rand() % 100);
+    }
+    else
+      for (j = 0; j < vars[i].size; j++)
+      { line();
+        printf("%s[%d] = %d;\n",vars[i].name,j,rand() % 100);
+      }
+}
+
+static void genBlock(int level, int nLocals);
+
+/* Procedure genStmt writes one statement at
+ * nesting level
+ */
+static void genStmt(int level)
+{ int kind = rand() % 10;
+  if ((level < maxDepth) && (kind < 2))
+  { line();
+    fputs("if (",stdout);
+    genCond();
+    fputs(")\n",stdout);
+    genBlock(level + 1,0);
+    if (chance(50))
+    { line();
+      fputs("else\n",stdout);
+      genBlock(level + 1,0);
+    }
+  }
+  else if ((level < maxDepth) && (kind < 4))
+  { /* the counter lives in a block of its own */
+    int mark = varCount;
+    VarRec * c;
+    line();
+    fputs("{\n",stdout);
+    indent++;
+    c = addVar('c',0);
+    c->readOnly = TRUE;
+    line();
+    printf("int %s;\n",c->name);
+    line();
+    printf("%s = 0;\n",c->name);
+    line();
+    printf("while (%s < %d)\n",c->name,LOOPS);
+    line();
+    fputs("{\n",stdout);
+    indent++;
+    genBlock(level + 1,-1);
+    line();
+    printf("%s = %s + 1;\n",vars[mark].name,vars[mark].name);
+    indent--;
+    line();
+    fputs("}\n",stdout);
+    indent--;
+    line();
+    fputs("}\n",stdout);
+    varCount = mark;
+  }
+  else
+  { VarRec * v = pickVar(chance(arrayPct),TRUE);
+    if (v == NULL) v = pickVar(FALSE,TRUE);
+    line();
+    genVar(v);
+    fputs(" = ",stdout);
+    genExp(1);
+    fputs(";\n",stdout);
+  }
+}
+
+/* Procedure genBlock writes a compound statement
+ * with nLocals new locals and nStmts statements;
+ * for nLocals < 0 it writes only the statements,
+ * into a block that is already open
+ */
+static void genBlock(int level, int nLocals)
+{ int i, mark = varCount;
+  if (nLocals >= 0)
+  { line();
+    fputs("{\n",stdout);
+    indent++;
+    genLocals(nLocals,FALSE);
+  }
+  for (i = 0; i < nStmts; i++) genStmt(level);
+  if (nLocals >= 0)
+  { indent--;
+    line();
+    fputs("}\n",stdout);
+  }
+  varCount = mark;
+}
+
+/* Procedure genFunc writes a function of int type
+ * that spends one unit of fuel per call
+ */
+static void genFunc(void)
+{ FuncRec f;
+  int i, mark = varCount;
+  int haveArray = (pickVar(TRUE,FALSE) != NULL);
+  newName(f.name,'f');
+  f.nParams = rand() % (MAXPARAMS + 1);
+  line();
+  printf("int %s(",f.name);
+  if (f.nParams == 0) fputs("void",stdout);
+  for (i = 0; i < f.nParams; i++)
+  { VarRec * p;
+    f.isArray[i] = haveArray && chance(arrayPct);
+    p = addVar('p',f.isArray[i] ? MINARRAY : 0);
+    if (i > 0) fputs(", ",stdout);
+    printf(f.isArray[i] ? "int %s[]" : "int %s",p->name);
+  }
+  fputs(")\n",stdout);
+  line();
+  fputs("{\n",stdout);
+  indent++;
+  /* an int local, so that every statement has a
+     variable to assign */
+  genLocals(1 + rand() % 3,TRUE);
+  line();
+  fputs("if (fuel < 1) return 0;\n",stdout);
+  line();
+  fputs("fuel = fuel - 1;\n",stdout);
+  for (i = 0; i < nStmts; i++) genStmt(0);
+  line();
+  fputs("return ",stdout);
+  genExp(1);
+  fputs(";\n",stdout);
+  indent--;
+  line();
+  fputs("}\n\n",stdout);
+  varCount = mark;
+  funcs[funcCount++] = f;
+}
+
+/* Procedure genMain writes main, which sets the
+ * fuel, calls the last functions and prints
+ * their results and the globals
+ */
+static void genMain(int nGlobalVars)
+{ int i;
+  line();
+  fputs("void main(void)\n",stdout);
+  line();
+  fputs("{\n",stdout);
+  indent++;
+  line();
+  printf("fuel = %d;\n",fuel);
+  for (i = (funcCount > 4) ? funcCount - 4 : 0; i < funcCount; i++)
+  { line();
+    fputs("output(",stdout);
+    genCall(&funcs[i],1);
+    fputs(");\n",stdout);
+  }
+  for (i = 0; i < nGlobalVars; i++)
+  { line();
+    fputs("output(",stdout);
+    genVar(&vars[i]);
+    fputs(");\n",stdout);
+  }
+  indent--;
+  line();
+  fputs("}\n",stdout);
+}
+
+/* Procedure usage describes the options and exits */
+static void usage(char * prog)
+{ fprintf(stderr,"usage: %s [options]\n",prog);
+  fprintf(stderr,"  -f n   functions besides main (%d)\n",nFuncs);
+  fprintf(stderr,"  -g n   global variables (%d)\n",nGlobals);
+  fprintf(stderr,"  -d n   nesting depth of if and while (%d)\n",maxDepth);
+  fprintf(stderr,"  -s n   statements in each block (%d)\n",nStmts);
+  fprintf(stderr,"  -l n   length of identifiers (%d)\n",idLen);
+  fprintf(stderr,"  -a n   percent of variables that are arrays (%d)\n",arrayPct);
+  fprintf(stderr,"  -c n   percent of operands that are calls (%d)\n",callPct);
+  fprintf(stderr,"  -u n   calls before functions return early (%d)\n",fuel);
+  fprintf(stderr,"  -r n   random seed (1)\n");
+  exit(1);
+}
+
+int main( int argc, char * argv[] )
+{ int i, seed = 1;
+  for (i = 1; i < argc; i++)
+  { int * opt = NULL;
+    if ((argv[i][0] != '-') || (argv[i][1] == '\0') || (argv[i][2] != '\0')
+        || (i + 1 >= argc))
+      usage(argv[0]);
+    switch (argv[i][1])
+    { case 'f': opt = &nFuncs; break;
+      case 'g': opt = &nGlobals; break;
+      case 'd': opt = &maxDepth; break;
+      case 's': opt = &nStmts; break;
+      case 'l': opt = &idLen; break;
+      case 'a': opt = &arrayPct; break;
+      case 'c': opt = &callPct; break;
+      case 'u': opt = &fuel; break;
+      case 'r': opt = &seed; break;
+      default: usage(argv[0]);
+    }
+    *opt = atoi(argv[++i]);
+    if (*opt < 0) usage(argv[0]);
+  }
+  srand(seed);
+  funcs = (FuncRec *) malloc((nFuncs + 1) * sizeof(FuncRec));
+  if (funcs == NULL)
+  { fprintf(stderr,"Out of memory\n");
+    exit(1);
+  }
+  for (i = 0; i < nGlobals; i++)
+  { VarRec * v = addVar('g',arraySize());
+    line();
+    if (v->size == 0) printf("int %s;\n",v->name);
+    else printf("int %s[%d];\n",v->name,v->size);
+  }
+  line();
+  fputs("int fuel;\n\n",stdout);
+  for (i = 0; i < nFuncs; i++) genFunc();
+  genMain(nGlobals);
+  return 0;
+}
@@ -12,21 +12,47 @@
 #include "scan.h"
 #include "parse.h"
 
-#define YYSTYPE TreeNode *
-static char * savedName; /* for use in assignments */
-static int savedLineNo;  /* ditto */
-static TreeNode * savedTree; /* stores syntax tree for later return */
-static int yylex(void);
-int yyerror(char*);
-TreeNode * parse(void);
+/* The state of parsing one file */
+typedef struct parseState
+  { Scanner scanner;
+    TreeNode * tree;     /* stores syntax tree for later return */
+    TokenType lastToken; /* for error messages */
+  } ParseState;
 %}
 
+%code requires {
+/* A SiblingList is a sibling list under
+ * construction, with its first and last node,
+ * so that appending to it does not walk it
+ */
+typedef struct
+  { struct treeNode * head;
+    struct treeNode * tail;
+  } SiblingList;
+}
+
+%union
+  { struct treeNode * node;
+    SiblingList list;
+  }
+
+%{
+static int yylex(YYSTYPE * lvalp, ParseState * ps);
+static int yyerror(ParseState * ps, const char * message);
+static SiblingList startList(TreeNode * t);
+static SiblingList appendList(SiblingList list, TreeNode * t);
+%}
+
+%define api.pure full
+%parse-param {struct parseState * ps}
+%lex-param {struct parseState * ps}
+
 %nonassoc IF
 %nonassoc ELSE
 %token WHILE RETURN
 %token INT VOID
 
-%token ID NUM 
+%token <node> ID NUM
 
 %left PLUS MINUS
 %left TIMES OVER
@@ -38,24 +64,20 @@ TreeNode * parse(void);
 
 %token ENDFILE ERROR 
 
+%type <list> decl_list param_list local_decls stmt_list arg_list
+%type <node> decl var_decl type identifier number func_decl params
+%type <node> param compound stmt exp_stmt if_stmt while_stmt return_stmt
+%type <node> exp var simple_exp relop add_exp addop term mulop factor
+%type <node> call args
+
 %% /* Grammar for C-MINUS */
 
 program     : decl_list
-                 { savedTree = $1;} 
+                 { ps->tree = $1.head;} 
             ;
 decl_list   : decl_list decl
-                { YYSTYPE t = $1;
-                  if (t != NULL)
-                  {
-                    while (t->sibling != NULL)
-                      t = t->sibling;
-                    t->sibling = $2;
-                    $$ = $1;
-                  }
-                  else
-                    $$ = $2;
-                }
-            | decl  { $$ = $1; }
+                { $$ = appendList($1,$2); }
+            | decl  { $$ = startList($1); }
             ;
 decl        : var_decl  { $$ = $1; }
             | func_decl { $$ = $1; }
@@ -63,7 +85,7 @@ decl        : var_decl  { $$ = $1; }
 var_decl    : type identifier SEMI
                 {
                   TreeNode *t = newDeclNode(VarDK);
-                  t->attr.name = copyString($2->attr.name);
+                  t->attr.name = $2->attr.name;
                   t->type = $1->type;
                   t->lineno = $2->lineno;
                   $$ = t;
@@ -71,7 +93,7 @@ var_decl    : type identifier SEMI
             | type identifier LBRACKET number RBRACKET SEMI
                 {
                   TreeNode *t = newDeclNode(VarDK);
-                  t->attr.name = copyString($2->attr.name);
+                  t->attr.name = $2->attr.name;
                   t->type = $1->type+2;
                   t->lineno = $2->lineno;
 
@@ -93,24 +115,14 @@ type        : INT
                   $$->type = Void;
                 }
             ;
-identifier  : ID
-                {
-                  TreeNode *t = newBasicNode();
-                  t->attr.name = copyString(tokenString);
-
-                  $$ = t;
-                }
+identifier  : ID  { $$ = $1; }
             ;
-number      : NUM
-                {
-                  $$ = newExpNode(ConstK);
-                  $$->attr.val = atoi(tokenString);
-                }
+number      : NUM { $$ = $1; }
             ;
 func_decl   : type identifier LPAREN params RPAREN compound
                 {
                   TreeNode *t = newDeclNode(FuncDK);
-                  t->attr.name = copyString($2->attr.name);
+                  t->attr.name = $2->attr.name;
                   t->type = $1->type;
                   t->lineno = $2->lineno;
                   t->child[0] = $4;
@@ -119,7 +131,7 @@ func_decl   : type identifier LPAREN params RPAREN compound
                   $$ = t;
                 }
             ;
-params      : param_list { $$ = $1; }
+params      : param_list { $$ = $1.head; }
             | VOID 
                 { 
                   TreeNode *t = newExpNode(ParamK);
@@ -129,24 +141,13 @@ params      : param_list { $$ = $1; }
                 }
             ;
 param_list  : param_list COMMA param
-                {
-                  YYSTYPE t = $1;
-                  if (t != NULL)
-                  {
-                    while (t->sibling != NULL)
-                      t = t->sibling;
-                    t->sibling = $3;
-                    $$ = $1;
-                  }
-                  else
-                    $$ = $3;
-                }
-            | param { $$ = $1; }
+                { $$ = appendList($1,$3); }
+            | param { $$ = startList($1); }
             ;
 param       : type identifier
                 {
                   TreeNode *t = newExpNode(ParamK);
-                  t->attr.name = copyString($2->attr.name);
+                  t->attr.name = $2->attr.name;
                   t->type = $1->type;
 
                   $$ = t;
@@ -154,7 +155,7 @@ param       : type identifier
             | type identifier LBRACKET RBRACKET
                 {
                   TreeNode *t = newExpNode(ParamK);
-                  t->attr.name = copyString($2->attr.name);
+                  t->attr.name = $2->attr.name;
                   t->type = $1->type+2;
 
                   $$ = t;
@@ -163,41 +164,19 @@ param       : type identifier
 compound    : LBRACE local_decls stmt_list RBRACE
                 {
                   TreeNode *t = newStmtNode(CompoundK);
-                  t->child[0] = $2;
-                  t->child[1] = $3;
+                  t->child[0] = $2.head;
+                  t->child[1] = $3.head;
 
                   $$ = t;
                 }
             ;
 local_decls : local_decls var_decl
-                {
-                  YYSTYPE t = $1;
-                  if (t != NULL)
-                  {
-                    while (t->sibling != NULL)
-                      t = t->sibling;
-                    t->sibling = $2;
-                    $$ = $1;
-                  }
-                  else
-                    $$ = $2;
-                }
-            | { $$ = NULL; }
+                { $$ = appendList($1,$2); }
+            | { $$ = startList(NULL); }
             ;
 stmt_list   : stmt_list stmt
-                {
-                  YYSTYPE t = $1;
-                  if (t != NULL)
-                  {
-                    while (t->sibling != NULL)
-                      t = t->sibling;
-                    t->sibling = $2;
-                    $$ = $1;
-                  }
-                  else
-                    $$ = $2;
-                }
-            | { $$ = NULL; }
+                { $$ = appendList($1,$2); }
+            | { $$ = startList(NULL); }
             ;
 stmt        : exp_stmt { $$ = $1; }
             | compound { $$ = $1; }
@@ -247,12 +226,12 @@ exp         : var ASSIGN exp
 var         : identifier
                 {
                   $$ = newExpNode(VarK);
-                  $$->attr.name = copyString($1->attr.name);
+                  $$->attr.name = $1->attr.name;
                 }
             | identifier LBRACKET exp RBRACKET
                 {
                   $$ = newExpNode(VarK);
-                  $$->attr.name = copyString($1->attr.name);
+                  $$->attr.name = $1->attr.name;
                   $$->child[0] = $3;
                 }
             ;
@@ -339,61 +318,77 @@ factor      : LPAREN exp RPAREN
                  { $$ = $2; }
             | var { $$ = $1; }
             | call { $$ = $1; }
-            | NUM
-                {
-                  $$ = newExpNode(ConstK);
-                  $$->attr.val = atoi(tokenString);
-                }
+            | NUM { $$ = $1; }
             ;
 call        : identifier LPAREN args RPAREN
               {
                 $$ = newExpNode(CallK);
-                $$->attr.name = copyString($1->attr.name);
+                $$->attr.name = $1->attr.name;
                 $$->child[0] = $3;
               }
             ;
-args        : arg_list  { $$ = $1; }
+args        : arg_list  { $$ = $1.head; }
             | { $$ = NULL; }
             ;
 arg_list    : arg_list COMMA exp
-                {
-                  YYSTYPE t = $1;
-                  if (t != NULL)
-                  {
-                    while (t->sibling != NULL)
-                      t = t->sibling;
-                    t->sibling = $3;
-                    $$ = $1;
-                  }
-                  else
-                    $$ = $3;
-                }
-            | exp { $$ = $1; }
+                { $$ = appendList($1,$3); }
+            | exp { $$ = startList($1); }
             ;
 
 %%
 
-int yyerror(char * message)
+static int yyerror(ParseState * ps, const char * message)
 { fprintf(listing,"Syntax error at line %d: %s\n",lineno,message);
   fprintf(listing,"Current token: ");
-  printToken(yychar,tokenString);
-  Error = TRUE;
+  printToken(ps->lastToken,tokenText(ps->scanner));
+  Error++;
   return 0;
 }
 
-/* yylex calls getToken to make Yacc/Bison output
- * compatible with ealier versions of the TINY scanner
+/* Function startList returns the sibling list
+ * of the nodes t, which may be NULL
  */
-static int yylex(void)
-{ return getToken(); }
+static SiblingList startList(TreeNode * t)
+{ SiblingList list;
+  list.head = list.tail = t;
+  if (t != NULL)
+    while (list.tail->sibling != NULL) list.tail = list.tail->sibling;
+  return list;
+}
 
+/* Function appendList appends the nodes t to the
+ * end of list and returns the longer list
+ */
+static SiblingList appendList(SiblingList list, TreeNode * t)
+{ if (t == NULL) return list;
+  if (list.head == NULL) return startList(t);
+  list.tail->sibling = t;
+  while (list.tail->sibling != NULL) list.tail = list.tail->sibling;
+  return list;
+}
+
+/* yylex calls getToken of the scanner of ps, which
+ * also makes the nodes of ID and NUM tokens; ENDFILE
+ * is the end of input for Yacc/Bison
+ */
+static int yylex(YYSTYPE * lvalp, ParseState * ps)
+{ lvalp->node = NULL;
+  ps->lastToken = getToken(ps->scanner, &lvalp->node);
+  return (ps->lastToken == ENDFILE) ? 0 : ps->lastToken;
+}
+
+/* Function parse parses the source file and returns
+ * its syntax tree, or NULL after a syntax error
+ */
 TreeNode * parse(void)
-{ 
-  yyparse();
-  if (savedTree == NULL) {
-    fprintf(listing, "Error: savedTree is NULL\n");
-    exit(1);
+{ ParseState ps;
+  memset(&ps, 0, sizeof(ps));
+  ps.scanner = newScanner(source);
+  yyparse(&ps);
+  freeScanner(ps.scanner);
+  if (ps.tree == NULL) {
+    fprintf(listing, "Error: no syntax tree was built\n");
+    Error++;
   }
-  return savedTree;
+  return ps.tree;
 }
-
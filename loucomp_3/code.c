@@ -7,21 +7,114 @@
 /****************************************************/
 
 #include "globals.h"
+#include "util.h"
 #include "code.h"
+#include "tmobj.h"
 
 /* TM location number for current instruction emission */
-static int emitLoc = 0 ;
+static THREADLOCAL int emitLoc = 0 ;
 
 /* Highest TM location emitted so far
    For use in conjunction with emitSkip,
    emitBackup, and emitRestore */
-static int highEmitLoc = 0;
+static THREADLOCAL int highEmitLoc = 0;
+
+/* opcode mnemonics in TM object record order */
+static char * opNames[] = { TMOBJ_OPCODES };
+
+/* Code is kept in memory until emitEnd, so that
+ * backpatched locations can still be optimized
+ * and the file is written in location order.
+ * A location that was skipped and never filled
+ * has op == NULL and is written as HALT
+ */
+typedef struct
+   { char * op ;
+     int rm ;          /* TRUE for register-memory format */
+     int a1, a2, a3 ;  /* r,s,t or r,d,s */
+     char * c ;        /* comment, printed if TraceCode */
+   } CodeRec;
+
+/* comment lines, each printed before the
+ * instruction at location loc
+ */
+typedef struct
+   { int loc ;
+     int seq ;         /* emission order */
+     char * text ;
+   } CommentRec;
+
+static THREADLOCAL CodeRec * codeBuf = NULL;
+static THREADLOCAL int codeSize = 0;
+static THREADLOCAL CommentRec * commentBuf = NULL;
+static THREADLOCAL int commentCount = 0, commentSize = 0;
+
+/* Procedure growCode makes codeBuf hold at
+ * least n locations
+ */
+static void growCode( int n)
+{ int newSize = codeSize ? codeSize : 256;
+  if (n <= codeSize) return;
+  while (newSize < n) newSize *= 2;
+  codeBuf = (CodeRec *) realloc(codeBuf, newSize * sizeof(CodeRec));
+  if (codeBuf == NULL)
+  { fprintf(stderr,"Out of memory for code buffer\n");
+    exit(1);
+  }
+  memset(codeBuf + codeSize, 0, (newSize - codeSize) * sizeof(CodeRec));
+  codeSize = newSize;
+} /* growCode */
+
+/* Procedure emitInstr stores one instruction at
+ * the current location and advances it
+ */
+static void emitInstr( char * op, int rm, int a1, int a2, int a3, char * c)
+{ growCode(emitLoc + 1);
+  codeBuf[emitLoc].op = op;
+  codeBuf[emitLoc].rm = rm;
+  codeBuf[emitLoc].a1 = a1;
+  codeBuf[emitLoc].a2 = a2;
+  codeBuf[emitLoc].a3 = a3;
+  codeBuf[emitLoc].c = c;
+  emitLoc++;
+  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+} /* emitInstr */
+
+/* Procedure emitRecord writes the TM object
+ * record of the next location
+ */
+static void emitRecord( char * op, int a1, int a2, int a3)
+{ int rec[4];
+  int i = 0;
+  while ((i < (int) (sizeof(opNames)/sizeof(opNames[0])))
+         && (strcmp(opNames[i],op) != 0))
+    i++;
+  if (i == (int) (sizeof(opNames)/sizeof(opNames[0])))
+  { fprintf(listing,"BUG: unknown TM opcode %s\n",op);
+    i = 0;
+  }
+  rec[0] = i; rec[1] = a1; rec[2] = a2; rec[3] = a3;
+  fwrite(rec, sizeof(rec), 1, code);
+} /* emitRecord */
 
 /* Procedure emitComment prints a comment line 
  * with comment c in the code file
  */
 void emitComment( char * c )
-{ if (TraceCode) fprintf(code,"* %s\n",c);}
+{ if (!TraceCode || BinaryCode) return;
+  if (commentCount == commentSize)
+  { commentSize = commentSize ? 2 * commentSize : 256;
+    commentBuf = (CommentRec *) realloc(commentBuf, commentSize * sizeof(CommentRec));
+    if (commentBuf == NULL)
+    { fprintf(stderr,"Out of memory for code buffer\n");
+      exit(1);
+    }
+  }
+  commentBuf[commentCount].loc = emitLoc;
+  commentBuf[commentCount].seq = commentCount;
+  commentBuf[commentCount].text = copyString(c);
+  commentCount++;
+} /* emitComment */
 
 /* Procedure emitRO emits a register-only
  * TM instruction
@@ -32,10 +125,7 @@ void emitComment( char * c )
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRO( char *op, int r, int s, int t, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d,%d ",emitLoc++,op,r,s,t);
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+{ emitInstr(op,FALSE,r,s,t,c);
 } /* emitRO */
 
 /* Procedure emitRM emits a register-to-memory
@@ -47,10 +137,7 @@ void emitRO( char *op, int r, int s, int t, char *c)
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRM( char * op, int r, int d, int s, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",emitLoc++,op,r,d,s);
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc)  highEmitLoc = emitLoc ;
+{ emitInstr(op,TRUE,r,d,s,c);
 } /* emitRM */
 
 /* Function emitSkip skips "howMany" code
@@ -60,6 +147,7 @@ void emitRM( char * op, int r, int d, int s, char *c)
 int emitSkip( int howMany)
 {  int i = emitLoc;
    emitLoc += howMany ;
+   growCode(emitLoc);
    if (highEmitLoc < emitLoc)  highEmitLoc = emitLoc ;
    return i;
 } /* emitSkip */
@@ -88,10 +176,269 @@ void emitRestore(void)
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRM_Abs( char *op, int r, int a, char * c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",
-               emitLoc,op,r,a-(emitLoc+1),pc);
-  ++emitLoc ;
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+{ emitInstr(op,TRUE,r,a-(emitLoc+1),pc,c);
 } /* emitRM_Abs */
+
+/**************************************************/
+/**********   Peephole optimization   *************/
+/**************************************************/
+
+/* The optimizer relies on cgen forming code
+ * addresses only pc-relatively: every RM
+ * instruction based on pc refers to location
+ * loc+1+d, and all other transfers of control
+ * (the return jump through ac1) go to such
+ * locations. Removed locations are closed up and
+ * every pc-relative displacement is relocated
+ */
+
+/* statistics, per pass */
+static THREADLOCAL int peepThreaded = 0;
+static THREADLOCAL int peepNoops = 0;
+static THREADLOCAL int peepStoreLoad = 0;
+static THREADLOCAL int peepDead = 0;
+
+/* instructions written by this thread so far */
+static THREADLOCAL long codeCount = 0;
+
+/* isPcRel is TRUE if p refers to its target pc-relatively */
+#define isPcRel(p) ((p)->op != NULL && (p)->rm && (p)->a3 == pc)
+
+/* isGoto is TRUE if p is an unconditional direct jump */
+#define isGoto(p) (isPcRel(p) && (p)->a1 == pc && strcmp((p)->op,"LDA") == 0)
+
+/* isCondJump is TRUE if p is a conditional jump */
+#define isCondJump(p) ((p)->op != NULL && (p)->op[0] == 'J')
+
+/* Function endsFlow returns TRUE if control never
+ * falls through p to the next location
+ */
+static int endsFlow( CodeRec * p)
+{ if ((p->op == NULL) || (strcmp(p->op,"HALT") == 0)) return TRUE;
+  return (p->a1 == pc) && !isCondJump(p);
+} /* endsFlow */
+
+/* Procedure markTargets sets target[i] for every
+ * location some instruction refers to
+ */
+static void markTargets( int n, char * target)
+{ int i, t;
+  memset(target, 0, n + 1);
+  target[0] = TRUE;
+  for (i = 0; i < n; i++)
+    if (isPcRel(&codeBuf[i]))
+    { t = i + 1 + codeBuf[i].a2;
+      if ((t >= 0) && (t <= n)) target[t] = TRUE;
+    }
+} /* markTargets */
+
+/* Function threadJumps makes jumps to
+ * unconditional jumps go to the final target
+ */
+static int threadJumps( int n)
+{ int i, t, steps, count = 0;
+  for (i = 0; i < n; i++)
+  { CodeRec * p = &codeBuf[i];
+    if (!isPcRel(p) || !((p->a1 == pc) || isCondJump(p))) continue;
+    t = i + 1 + p->a2;
+    steps = 0;
+    while ((t >= 0) && (t < n) && isGoto(&codeBuf[t]) && (steps < n))
+    { t = t + 1 + codeBuf[t].a2;
+      steps++;
+    }
+    if ((steps > 0) && (steps < n))
+    { p->a2 = t - (i + 1);
+      count++;
+    }
+  }
+  return count;
+} /* threadJumps */
+
+/* Function markNoops marks jumps to the next
+ * location and moves of a register to itself
+ */
+static int markNoops( int n, char * dead)
+{ int i, count = 0;
+  for (i = 0; i < n; i++)
+  { CodeRec * p = &codeBuf[i];
+    if (dead[i] || (p->op == NULL) || !p->rm || (p->a2 != 0)) continue;
+    /* a jump to the next location, or LDA r,0(r) */
+    if (isGoto(p) || ((p->a3 == pc) && isCondJump(p))
+        || ((strcmp(p->op,"LDA") == 0) && (p->a1 == p->a3)))
+    { dead[i] = TRUE;
+      count++;
+    }
+  }
+  return count;
+} /* markNoops */
+
+/* Function markStoreLoad marks a load that follows
+ * a store of the same register to the same place,
+ * and a store back of a value just loaded
+ */
+static int markStoreLoad( int n, char * target, char * dead)
+{ int i, count = 0;
+  for (i = 0; i + 1 < n; i++)
+  { CodeRec * p = &codeBuf[i], * q = &codeBuf[i+1];
+    if (dead[i] || dead[i+1] || target[i+1]) continue;
+    if ((p->op == NULL) || (q->op == NULL) || !p->rm || !q->rm) continue;
+    if ((p->a1 != q->a1) || (p->a2 != q->a2) || (p->a3 != q->a3)) continue;
+    if (p->a1 == pc) continue;
+    if (((strcmp(p->op,"ST") == 0) && (strcmp(q->op,"LD") == 0))
+        || ((strcmp(p->op,"LD") == 0) && (strcmp(q->op,"ST") == 0)
+            && (p->a1 != p->a3)))
+    { dead[i+1] = TRUE;
+      count++;
+    }
+  }
+  return count;
+} /* markStoreLoad */
+
+/* Function markDead marks code that follows an
+ * unconditional transfer and is not a target
+ */
+static int markDead( int n, char * target, char * dead)
+{ int i, count = 0, reachable = TRUE;
+  for (i = 0; i < n; i++)
+  { if (target[i]) reachable = TRUE;
+    if (!reachable && !dead[i])
+    { dead[i] = TRUE;
+      count++;
+    }
+    if (reachable && !dead[i] && endsFlow(&codeBuf[i]))
+      reachable = FALSE;
+  }
+  return count;
+} /* markDead */
+
+/* Procedure compact removes dead locations and
+ * relocates displacements and comments; it
+ * returns the new code size
+ */
+static int compact( int n, char * dead)
+{ int * newLoc = (int *) malloc((n + 1) * sizeof(int));
+  int i, t, m = 0;
+  for (i = 0; i < n; i++)
+  { newLoc[i] = m;
+    if (!dead[i]) m++;
+  }
+  newLoc[n] = m;
+  for (i = 0; i < n; i++)
+    if (!dead[i] && isPcRel(&codeBuf[i]))
+    { t = i + 1 + codeBuf[i].a2;
+      if ((t >= 0) && (t <= n))
+        codeBuf[i].a2 = newLoc[t] - (newLoc[i] + 1);
+    }
+  for (i = 0; i < n; i++)
+    if (!dead[i]) codeBuf[newLoc[i]] = codeBuf[i];
+  for (i = 0; i < commentCount; i++)
+    if (commentBuf[i].loc <= n)
+      commentBuf[i].loc = newLoc[commentBuf[i].loc];
+  free(newLoc);
+  return m;
+} /* compact */
+
+/* Procedure peephole optimizes the buffered code,
+ * repeating its passes until none applies
+ */
+static void peephole(void)
+{ int n, m = highEmitLoc;
+  char * target = (char *) malloc(m + 1);
+  char * dead = (char *) malloc(m + 1);
+  do
+  { n = m;
+    peepThreaded += threadJumps(n);
+    markTargets(n, target);
+    memset(dead, 0, n + 1);
+    peepNoops += markNoops(n, dead);
+    peepStoreLoad += markStoreLoad(n, target, dead);
+    peepDead += markDead(n, target, dead);
+    m = compact(n, dead);
+  } while (m < n);
+  free(target);
+  free(dead);
+  n = highEmitLoc;
+  emitLoc = highEmitLoc = m;
+  fprintf(listing,"\nPeephole optimization: %d -> %d instructions\n",n,m);
+  fprintf(listing,"  jump chains threaded    %d\n",peepThreaded);
+  fprintf(listing,"  no-ops removed          %d\n",peepNoops);
+  fprintf(listing,"  store/load removed      %d\n",peepStoreLoad);
+  fprintf(listing,"  dead code removed       %d\n",peepDead);
+} /* peephole */
+
+/* Procedure writeCode writes the buffered code
+ * to the code file, as TM text or as a TM object
+ * header followed by one record per location
+ */
+static void writeCode(void)
+{ int i, j = 0;
+  TMOBJHEADER h;
+  if (BinaryCode)
+  { memcpy(h.magic,TMOBJ_MAGIC,sizeof(h.magic));
+    h.version = TMOBJ_VERSION;
+    h.size = highEmitLoc;
+    h.dsize = 0;
+    fwrite(&h, sizeof(h), 1, code);
+  }
+  for (i = 0; i < highEmitLoc; i++)
+  { CodeRec * p = &codeBuf[i];
+    char * op = (p->op == NULL) ? "HALT" : p->op;
+    if (BinaryCode)
+    { emitRecord(op,p->a1,p->a2,p->a3);
+      continue;
+    }
+    for ( ; (j < commentCount) && (commentBuf[j].loc <= i); j++)
+      fprintf(code,"* %s\n",commentBuf[j].text);
+    if (p->op == NULL) continue;
+    if (p->rm)
+      fprintf(code,"%3d:  %5s  %d,%d(%d) ",i,op,p->a1,p->a2,p->a3);
+    else
+      fprintf(code,"%3d:  %5s  %d,%d,%d ",i,op,p->a1,p->a2,p->a3);
+    if (TraceCode) fprintf(code,"\t%s",p->c) ;
+    fprintf(code,"\n") ;
+  }
+  for ( ; j < commentCount; j++)
+    fprintf(code,"* %s\n",commentBuf[j].text);
+} /* writeCode */
+
+/* Function compareComments orders comments by
+ * location, keeping emission order within one
+ */
+static int compareComments( const void * a, const void * b)
+{ const CommentRec * x = (const CommentRec *) a;
+  const CommentRec * y = (const CommentRec *) b;
+  if (x->loc != y->loc) return (x->loc < y->loc) ? -1 : 1;
+  return x->seq - y->seq;
+} /* compareComments */
+
+/* Procedure resetCode empties the code buffer
+ * for the next compilation on this thread
+ */
+static void resetCode(void)
+{ free(codeBuf);
+  free(commentBuf);
+  codeBuf = NULL;
+  commentBuf = NULL;
+  codeSize = commentCount = commentSize = 0;
+  emitLoc = highEmitLoc = 0;
+  peepThreaded = peepNoops = peepStoreLoad = peepDead = 0;
+} /* resetCode */
+
+/* Function emitCount returns the number of
+ * instructions written by this thread so far
+ */
+long emitCount(void)
+{ return codeCount; }
+
+/* Procedure emitEnd completes the code file:
+ * it runs the peephole optimizer if Peephole is
+ * TRUE and writes the buffered code
+ */
+void emitEnd(void)
+{ if (Peephole) peephole();
+  if (commentCount > 0)
+    qsort(commentBuf, commentCount, sizeof(CommentRec), compareComments);
+  writeCode();
+  codeCount += highEmitLoc;
+  resetCode();
+} /* emitEnd */
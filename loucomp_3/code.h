@@ -23,6 +23,11 @@
  */
 #define gp 5
 
+/* fp = "frame pointer" points to the
+ * activation record of the current function
+ */
+#define fp 4
+
 /* accumulator */
 #define  ac 0
 
@@ -83,4 +88,15 @@ void emitRestore(void);
  */
 void emitRM_Abs( char *op, int r, int a, char * c);
 
+/* Function emitCount returns the number of
+ * instructions written by this thread so far
+ */
+long emitCount(void);
+
+/* Procedure emitEnd completes the code file.
+ * For a TM object it writes the header with
+ * the final program size
+ */
+void emitEnd(void);
+
 #endif
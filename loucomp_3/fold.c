@@ -0,0 +1,181 @@
+/****************************************************/
+/* File: fold.c                                     */
+/* Constant folding and algebraic simplification    */
+/* on the syntax tree of the C-MINUS compiler       */
+/****************************************************/
+
+#include <limits.h>
+#include "globals.h"
+#include "fold.h"
+
+/* counters reported to the listing */
+static THREADLOCAL int foldedOps = 0;   /* operators computed at compile time */
+static THREADLOCAL int identities = 0;  /* x+0, x*1, x*0 and the like */
+static THREADLOCAL int branches = 0;    /* if and while tests made constant */
+
+/* Function isConst returns TRUE if t is the
+ * constant c, or any constant if c is NULL
+ */
+static int isConst( TreeNode * t, int * c)
+{ if ((t == NULL) || (t->nodekind != ExpK) || (t->kind.exp != ConstK))
+    return FALSE;
+  return (c == NULL) || (t->attr.val == *c);
+} /* isConst */
+
+/* Function isPure returns TRUE if evaluating
+ * expression t has no side effects, so that its
+ * code can be dropped. A division that may stop
+ * TM on a zero divisor is not pure
+ */
+static int isPure( TreeNode * t)
+{ int i, zero = 0;
+  if (t == NULL) return TRUE;
+  if ((t->nodekind == ExpK)
+      && ((t->kind.exp == CallK) || (t->kind.exp == AssignK)))
+    return FALSE;
+  if ((t->nodekind == ExpK) && (t->kind.exp == OpK) && (t->attr.op == OVER)
+      && (!isConst(t->child[1],NULL) || isConst(t->child[1],&zero)))
+    return FALSE;
+  for (i = 0; i < MAXCHILDREN; i++)
+    if (!isPure(t->child[i])) return FALSE;
+  return TRUE;
+} /* isPure */
+
+/* Function evalOp computes a op b as TM would,
+ * wrapping on overflow; it returns FALSE if the
+ * result must be left to run time. Comparisons
+ * test the wrapped difference a - b against 0,
+ * as the SUB and jump emitted by cgen do
+ */
+static int evalOp( TokenType op, int a, int b, int * result)
+{ int d = (int) ((unsigned) a - (unsigned) b);
+  switch (op) {
+    case PLUS :  *result = (int) ((unsigned) a + (unsigned) b); break;
+    case MINUS : *result = (int) ((unsigned) a - (unsigned) b); break;
+    case TIMES : *result = (int) ((unsigned) a * (unsigned) b); break;
+    case OVER :
+      /* TM stops on division by zero */
+      if ((b == 0) || ((a == INT_MIN) && (b == -1))) return FALSE;
+      *result = a / b;
+      break;
+    case LT : *result = d < 0; break;
+    case LE : *result = d <= 0; break;
+    case GT : *result = d > 0; break;
+    case GE : *result = d >= 0; break;
+    case EQ : *result = d == 0; break;
+    case NE : *result = d != 0; break;
+    default : return FALSE;
+  }
+  return TRUE;
+} /* evalOp */
+
+/* Procedure makeConst turns node t into the
+ * integer constant val
+ */
+static void makeConst( TreeNode * t, int val)
+{ int i;
+  for (i = 0; i < MAXCHILDREN; i++) t->child[i] = NULL;
+  t->kind.exp = ConstK;
+  t->attr.val = val;
+  t->type = Integer;
+} /* makeConst */
+
+/* Function foldOp simplifies operator node t and
+ * returns the node that replaces it
+ */
+static TreeNode * foldOp( TreeNode * t)
+{ TreeNode * l = t->child[0];
+  TreeNode * r = t->child[1];
+  int zero = 0, one = 1, val;
+  if (isConst(l,NULL) && isConst(r,NULL))
+  { if (evalOp(t->attr.op,l->attr.val,r->attr.val,&val))
+    { makeConst(t,val);
+      foldedOps++;
+    }
+    return t;
+  }
+  switch (t->attr.op) {
+    case PLUS :
+      if (isConst(r,&zero)) { identities++; return l; }
+      if (isConst(l,&zero)) { identities++; return r; }
+      break;
+    case MINUS :
+      if (isConst(r,&zero)) { identities++; return l; }
+      break;
+    case TIMES :
+      if (isConst(r,&one)) { identities++; return l; }
+      if (isConst(l,&one)) { identities++; return r; }
+      if ((isConst(r,&zero) && isPure(l)) || (isConst(l,&zero) && isPure(r)))
+      { makeConst(t,0);
+        identities++;
+      }
+      break;
+    case OVER :
+      if (isConst(r,&one)) { identities++; return l; }
+      break;
+    default :
+      break;
+  }
+  return t;
+} /* foldOp */
+
+static TreeNode * foldList( TreeNode * t);
+
+/* Function foldNode simplifies the tree rooted at
+ * t (but not its siblings) and returns the node
+ * that replaces it, or NULL if it is removed
+ */
+static TreeNode * foldNode( TreeNode * t)
+{ int i;
+  for (i = 0; i < MAXCHILDREN; i++)
+    t->child[i] = foldList(t->child[i]);
+  if ((t->nodekind == ExpK) && (t->kind.exp == OpK))
+    return foldOp(t);
+  if (t->nodekind == StmtK)
+    switch (t->kind.stmt) {
+      case IfK :
+      case IfElseK :
+        if (!isConst(t->child[0],NULL)) break;
+        branches++;
+        return t->child[0]->attr.val ? t->child[1] : t->child[2];
+      case WhileK :
+        if (!isConst(t->child[0],NULL) || t->child[0]->attr.val) break;
+        branches++;
+        return NULL;
+      default :
+        break;
+    }
+  return t;
+} /* foldNode */
+
+/* Function foldList simplifies each node of the
+ * sibling list t and relinks the survivors
+ */
+static TreeNode * foldList( TreeNode * t)
+{ TreeNode * head = NULL;
+  TreeNode ** link = &head;
+  TreeNode * next, * r;
+  while (t != NULL)
+  { next = t->sibling;
+    r = foldNode(t);
+    if (r != NULL)
+    { *link = r;
+      link = &r->sibling;
+    }
+    t = next;
+  }
+  *link = NULL;
+  return head;
+} /* foldList */
+
+/* Function foldConstants simplifies a type checked
+ * syntax tree before code generation
+ */
+TreeNode * foldConstants(TreeNode * syntaxTree)
+{ foldedOps = identities = branches = 0;
+  syntaxTree = foldList(syntaxTree);
+  fprintf(listing,"\nConstant folding: %d operators folded, "
+                  "%d identities simplified, %d tests collapsed\n",
+          foldedOps,identities,branches);
+  return syntaxTree;
+} /* foldConstants */
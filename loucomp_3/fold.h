@@ -0,0 +1,18 @@
+/****************************************************/
+/* File: fold.h                                     */
+/* Constant folding interface for the C-MINUS       */
+/* compiler                                         */
+/****************************************************/
+
+#ifndef _FOLD_H_
+#define _FOLD_H_
+
+/* Function foldConstants simplifies a type checked
+ * syntax tree before code generation: it folds
+ * constant operators, removes identities such as
+ * x+0 and x*1, and collapses if and while statements
+ * with constant tests. It returns the new tree
+ */
+TreeNode * foldConstants(TreeNode * syntaxTree);
+
+#endif
@@ -26,6 +26,9 @@
 
 #ifndef YYPARSER
 
+/* the state of the pure parser, which yyparse takes */
+struct parseState;
+
 /* the name of the following file may change */
 #include "y.tab.h"
 
@@ -54,11 +57,21 @@
  */
 typedef int TokenType; 
 
-extern FILE* source; /* source code text file */
-extern FILE* listing; /* listing output text file */
-extern FILE* code; /* code text file for TM simulator */
+/* THREADLOCAL marks the state of one compilation
+ * that all phases share; each thread compiling a
+ * file has its own copy
+ */
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+#define THREADLOCAL _Thread_local
+#else
+#define THREADLOCAL __thread
+#endif
+
+extern THREADLOCAL FILE* source; /* source code text file */
+extern THREADLOCAL FILE* listing; /* listing output text file */
+extern THREADLOCAL FILE* code; /* code text file for TM simulator */
 
-extern int lineno; /* source line number for listing */
+extern THREADLOCAL int lineno; /* source line number for listing */
 
 /**************************************************/
 /***********   Syntax tree for parsing ************/
@@ -85,6 +98,12 @@ typedef struct treeNode
              int val;
              char * name; } attr;
      ExpType type; /* for type checking of exps */
+     /* filled in by the analyzer for code generation */
+     struct treeNode * decl; /* VarK, CallK: declaration of the name */
+     int memloc; /* VarDK, ParamK: symbol table location;
+                    FuncDK: entry address, set by cgen */
+     int level;  /* VarDK, ParamK: scope level, 0 = global */
+     int size;   /* FuncDK: words of parameters and locals */
    } TreeNode;
 
 /**************************************************/
@@ -119,6 +138,31 @@ extern int TraceAnalyze;
  */
 extern int TraceCode;
 
-/* Error = TRUE prevents further passes if an error occurs */
-extern int Error; 
+/* FoldConst = TRUE causes constant subtrees of the
+ * syntax tree to be folded before code generation
+ */
+extern int FoldConst;
+
+/* RegAlloc = TRUE causes the code generator to keep
+ * expression temporaries in free TM registers,
+ * spilling to memory only when they run out
+ */
+extern int RegAlloc;
+
+/* Peephole = TRUE causes the emitted TM code to be
+ * optimized by the peephole pass in code.c before
+ * it is written
+ */
+extern int Peephole;
+
+/* BinaryCode = TRUE causes the code generator to
+ * write a binary TM object file (see tmobj.h)
+ * instead of TM assembly text
+ */
+extern int BinaryCode;
+
+/* Error counts the errors reported; a nonzero
+ * count prevents further passes
+ */
+extern THREADLOCAL int Error; 
 #endif
@@ -7,34 +7,23 @@
 
 #include "globals.h"
 
-/* set NO_PARSE to TRUE to get a scanner-only compiler */
-#define NO_PARSE FALSE
-/* set NO_ANALYZE to TRUE to get a parser-only compiler */
-#define NO_ANALYZE FALSE
-
-/* set NO_CODE to TRUE to get a compiler that does not
- * generate code
- */
-#define NO_CODE TRUE
-
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
 #include "util.h"
-#if NO_PARSE
 #include "scan.h"
-#else
 #include "parse.h"
-#if !NO_ANALYZE
 #include "analyze.h"
-#if !NO_CODE
+#include "symtab.h"
+#include "fold.h"
+#include "code.h"
 #include "cgen.h"
-#endif
-#endif
-#endif
 
 /* allocate global variables */
-int lineno = 0;
-FILE * source;
-FILE * listing;
-FILE * code;
+THREADLOCAL int lineno = 0;
+THREADLOCAL FILE * source;
+THREADLOCAL FILE * listing;
+THREADLOCAL FILE * code;
 
 /* allocate and set tracing flags */
 int EchoSource = FALSE;
@@ -42,63 +31,447 @@ int TraceScan = FALSE;
 int TraceParse = FALSE;
 int TraceAnalyze = TRUE;
 int TraceCode = FALSE;
+int FoldConst = FALSE;
+int RegAlloc = FALSE;
+int Peephole = FALSE;
+int BinaryCode = FALSE;
 
-int Error = FALSE;
+THREADLOCAL int Error = FALSE;
 
-int main( int argc, char * argv[] )
-{ TreeNode * syntaxTree;
-  char pgm[120]; /* source code file name */
-  if (argc != 2)
-    { fprintf(stderr,"usage: %s <filename>\n",argv[0]);
-      exit(1);
+/* the stages of compilation, in order */
+typedef enum {ScanStage, ParseStage, AnalyzeStage, CodeStage} Stage;
+
+/* StopAfter = the last stage run: ScanStage gives a
+ * scanner-only compiler, ParseStage a parser-only
+ * one and AnalyzeStage one that does not generate
+ * code
+ */
+static Stage StopAfter = CodeStage;
+
+/* MAXTHREADS = the largest number of worker threads */
+#define MAXTHREADS 64
+
+/* status of compiling one file */
+typedef enum {CompileOK, CompileErrors, CompileNoFile} CompileStatus;
+
+/* the phases measured by the time report; parsing
+ * includes scanning, which is timed on its own
+ * only when the compiler stops after it
+ */
+typedef enum {ScanPhase, ParsePhase, SymtabPhase, TypePhase, FoldPhase,
+              CodePhase, MAXPHASE} Phase;
+static char * phaseNames[MAXPHASE] =
+  {"scan", "parse", "symtab", "typecheck", "fold", "codegen"};
+
+/* the form of the time report, if any */
+typedef enum {NoReport, TableReport, JsonReport} ReportKind;
+static ReportKind TimeReport = NoReport;
+
+/* The work done by one phase, or the totals at one
+ * instant. Allocations are those from the arenas
+ * only, and are labelled so in the report; code
+ * buffers and scanner buffers are not counted. The
+ * peak RSS, in kilobytes, is of the process
+ */
+typedef struct
+   { int ran;
+     double wall, cpu;
+     long allocs, bytes, maxrss;
+     long tokens, nodes, scopes, symbols, instrs;
+   } PhaseRec;
+
+/* Procedure snapshot stores the clocks and counts
+ * of the calling thread at this instant in p
+ */
+static void snapshot(PhaseRec * p)
+{ struct timespec ts;
+  struct rusage ru;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  p->wall = ts.tv_sec + ts.tv_nsec / 1e9;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts);
+  p->cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+  getrusage(RUSAGE_SELF,&ru);
+  p->maxrss = ru.ru_maxrss;
+  arenaCounts(&p->allocs,&p->bytes,&p->nodes);
+  st_counts(&p->scopes,&p->symbols);
+  p->tokens = countTokens();
+  p->instrs = emitCount();
+}
+
+/* Procedure endPhase stores in p the work done
+ * since the snapshot start
+ */
+static void endPhase(PhaseRec * start, PhaseRec * p)
+{ PhaseRec end;
+  snapshot(&end);
+  p->ran = TRUE;
+  p->wall = end.wall - start->wall;
+  p->cpu = end.cpu - start->cpu;
+  p->allocs = end.allocs - start->allocs;
+  p->bytes = end.bytes - start->bytes;
+  p->maxrss = end.maxrss;
+  p->tokens = end.tokens - start->tokens;
+  p->nodes = end.nodes - start->nodes;
+  p->scopes = end.scopes - start->scopes;
+  p->symbols = end.symbols - start->symbols;
+  p->instrs = end.instrs - start->instrs;
+}
+
+/* Procedure printReport prints the work of the
+ * phases that ran, and their total, to the listing
+ */
+static void printReport(char * pgm, PhaseRec * phases)
+{ PhaseRec total;
+  int i, first = TRUE;
+  memset(&total,0,sizeof(total));
+  if (TimeReport == TableReport)
+  { fprintf(listing,"\nTime report: %s\n",pgm);
+    fprintf(listing,"%-10s %9s %9s %12s %12s %9s %8s %8s %7s %8s %8s\n",
+            "phase","wall ms","cpu ms","arena allocs","arena bytes","peak KB",
+            "tokens","nodes","scopes","symbols","instrs");
+  }
+  else
+    fprintf(listing,"{\"file\": \"%s\", \"phases\": [",pgm);
+  for (i = 0; i <= MAXPHASE; i++)
+  { PhaseRec * p = (i < MAXPHASE) ? &phases[i] : &total;
+    char * name = (i < MAXPHASE) ? phaseNames[i] : "total";
+    if ((i < MAXPHASE) && !p->ran) continue;
+    if (i < MAXPHASE)
+    { total.wall += p->wall;
+      total.cpu += p->cpu;
+      total.allocs += p->allocs;
+      total.bytes += p->bytes;
+      if (p->maxrss > total.maxrss) total.maxrss = p->maxrss;
+      total.tokens += p->tokens;
+      total.nodes += p->nodes;
+      total.scopes += p->scopes;
+      total.symbols += p->symbols;
+      total.instrs += p->instrs;
     }
-  strcpy(pgm,argv[1]) ;
-  if (strchr (pgm, '.') == NULL)
-     strcat(pgm,".tny");
+    if (TimeReport == TableReport)
+      fprintf(listing,"%-10s %9.3f %9.3f %12ld %12ld %9ld %8ld %8ld %7ld %8ld %8ld\n",
+              name,p->wall * 1e3,p->cpu * 1e3,p->allocs,p->bytes,p->maxrss,
+              p->tokens,p->nodes,p->scopes,p->symbols,p->instrs);
+    else
+    { fprintf(listing,"%s\n  {\"phase\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+              "\"arena_allocs\": %ld, \"arena_bytes\": %ld, \"peak_rss_kb\": %ld, "
+              "\"tokens\": %ld, \"nodes\": %ld, \"scopes\": %ld, "
+              "\"symbols\": %ld, \"instrs\": %ld}",
+              first ? "" : ",",name,p->wall * 1e3,p->cpu * 1e3,p->allocs,
+              p->bytes,p->maxrss,p->tokens,p->nodes,p->scopes,p->symbols,
+              p->instrs);
+      first = FALSE;
+    }
+  }
+  if (TimeReport == JsonReport) fprintf(listing,"\n]}\n");
+}
+
+/* Function fileName returns a new string holding
+ * pgm with its extension replaced by ext
+ */
+static char * fileName(char * pgm, char * ext)
+{ char * base = strrchr(pgm,'/');
+  char * dot = strrchr((base == NULL) ? pgm : base,'.');
+  int len = (dot == NULL) ? (int) strlen(pgm) : (int) (dot - pgm);
+  char * name = (char *) malloc(len + strlen(ext) + 1);
+  if (name == NULL)
+  { fprintf(stderr,"Out of memory\n");
+    exit(1);
+  }
+  memcpy(name,pgm,len);
+  strcpy(name + len,ext);
+  return name;
+}
+
+/* Function compile runs all phases on the source
+ * file pgm, writing the listing to the file lstfile,
+ * or to the screen if lstfile is NULL, and the code
+ * next to pgm. The listing is only created once the
+ * source is open. It only uses the state of the
+ * calling thread, so files can be compiled in parallel
+ */
+static CompileStatus compile(char * pgm, char * lstfile)
+{ TreeNode * syntaxTree;
+  PhaseRec phases[MAXPHASE], start;
   source = fopen(pgm,"r");
   if (source==NULL)
   { fprintf(stderr,"File %s not found\n",pgm);
-    exit(1);
+    return CompileNoFile;
+  }
+  listing = (lstfile == NULL) ? stdout : fopen(lstfile,"w");
+  if (listing == NULL)
+  { fprintf(stderr,"Unable to open %s\n",lstfile);
+    fclose(source);
+    return CompileNoFile;
   }
-  listing = stdout; /* send listing to screen */
+  lineno = 0;
+  Error = FALSE;
   fprintf(listing,"\nC-MINUS COMPILATION: %s\n",pgm);
-#if NO_PARSE
-  while (getToken()!=ENDFILE);
-#else
-  syntaxTree = parse();
-  if (TraceParse) {
+  memset(phases,0,sizeof(phases));
+  snapshot(&start);
+  if (StopAfter == ScanStage)
+  { Scanner s = newScanner(source);
+    while (getToken(s,NULL)!=ENDFILE);
+    freeScanner(s);
+    syntaxTree = NULL;
+    endPhase(&start,&phases[ScanPhase]);
+  }
+  else
+  { syntaxTree = parse();
+    endPhase(&start,&phases[ParsePhase]);
+  }
+  if (TraceParse && (syntaxTree != NULL)) {
     fprintf(listing,"\nSyntax tree:\n");
     printTree(syntaxTree);
   }
-#if !NO_ANALYZE
-  if (! Error)
-  { 
+  if ((! Error) && (StopAfter >= AnalyzeStage))
+  { snapshot(&start);
     init_scopeList();
     if (TraceAnalyze) fprintf(listing,"\nBuilding Symbol Table...\n");
     buildSymtab(syntaxTree);
+    endPhase(&start,&phases[SymtabPhase]);
     if (TraceAnalyze) fprintf(listing,"\nChecking Types...\n");
+    snapshot(&start);
     typeCheck(syntaxTree);
+    endPhase(&start,&phases[TypePhase]);
     if (TraceAnalyze) fprintf(listing,"\nType Checking Finished\n");
   }
-#if !NO_CODE
-  if (! Error)
-  { char * codefile;
-    int fnlen = strcspn(pgm,".");
-    codefile = (char *) calloc(fnlen+4, sizeof(char));
-    strncpy(codefile,pgm,fnlen);
-    strcat(codefile,".tm");
-    code = fopen(codefile,"w");
+  if ((! Error) && (StopAfter >= CodeStage) && FoldConst)
+  { snapshot(&start);
+    syntaxTree = foldConstants(syntaxTree);
+    endPhase(&start,&phases[FoldPhase]);
+  }
+  if ((! Error) && (StopAfter >= CodeStage))
+  { char * codefile = fileName(pgm,BinaryCode ? ".tmo" : ".tm");
+    code = fopen(codefile,BinaryCode ? "wb" : "w");
     if (code == NULL)
-    { printf("Unable to open %s\n",codefile);
-      exit(1);
+    { fprintf(listing,"Unable to open %s\n",codefile);
+      Error++;
+    }
+    else
+    { snapshot(&start);
+      codeGen(syntaxTree,codefile);
+      fclose(code);
+      endPhase(&start,&phases[CodePhase]);
     }
-    codeGen(syntaxTree,codefile);
-    fclose(code);
+    free(codefile);
   }
-#endif
-#endif
-#endif
+  if (TimeReport != NoReport) printReport(pgm,phases);
+  releaseArenas();
   fclose(source);
-  return 0;
+  if (lstfile != NULL) fclose(listing);
+  return Error ? CompileErrors : CompileOK;
 }
 
+/* the files of a batch, which the worker
+ * threads take in order
+ */
+typedef struct
+   { char ** files;
+     int count;
+     int next;              /* next file to compile */
+     CompileStatus * status;
+     int * errors;          /* errors reported per file */
+     pthread_mutex_t lock;
+   } Batch;
+
+/* Procedure worker compiles files of the batch arg
+ * until none are left; each listing goes to the
+ * .lst file of its source
+ */
+static void * worker(void * arg)
+{ Batch * b = (Batch *) arg;
+  for (;;)
+  { int i;
+    char * lstfile;
+    pthread_mutex_lock(&b->lock);
+    i = b->next++;
+    pthread_mutex_unlock(&b->lock);
+    if (i >= b->count) break;
+    lstfile = fileName(b->files[i],".lst");
+    b->status[i] = compile(b->files[i],lstfile);
+    if (b->status[i] == CompileErrors) b->errors[i] = Error;
+    free(lstfile);
+  }
+  return NULL;
+}
+
+/* Procedure addFile appends name to the file list,
+ * adding the extension .tny if it has none
+ */
+static void addFile(Batch * b, char * name, int * max)
+{ char * base = strrchr(name,'/');
+  if (strchr((base == NULL) ? name : base,'.') == NULL)
+    name = fileName(name,".tny");
+  if (b->count == *max)
+  { *max = *max ? 2 * *max : 16;
+    b->files = (char **) realloc(b->files, *max * sizeof(char *));
+    if (b->files == NULL)
+    { fprintf(stderr,"Out of memory\n");
+      exit(1);
+    }
+  }
+  b->files[b->count++] = name;
+}
+
+/* Procedure readResponseFile appends the file names
+ * listed in the response file name, separated by
+ * white space, to the file list
+ */
+static void readResponseFile(Batch * b, char * name, int * max)
+{ char word[1024];
+  FILE * f = fopen(name,"r");
+  if (f == NULL)
+  { fprintf(stderr,"File %s not found\n",name);
+    exit(1);
+  }
+  while (fscanf(f,"%1023s",word) == 1)
+    addFile(b,strdup(word),max);
+  fclose(f);
+}
+
+/* Function runBatch compiles the files of b on
+ * nthreads threads and prints a summary of the
+ * diagnostics; it returns the number of files
+ * that failed
+ */
+static int runBatch(Batch * b, int nthreads)
+{ pthread_t threads[MAXTHREADS];
+  int i, ok = 0, failed = 0, missing = 0, errors = 0;
+  b->next = 0;
+  b->status = (CompileStatus *) calloc(b->count, sizeof(CompileStatus));
+  b->errors = (int *) calloc(b->count, sizeof(int));
+  if ((b->status == NULL) || (b->errors == NULL))
+  { fprintf(stderr,"Out of memory\n");
+    exit(1);
+  }
+  pthread_mutex_init(&b->lock,NULL);
+  if (nthreads > b->count) nthreads = b->count;
+  for (i = 0; i < nthreads; i++)
+    if (pthread_create(&threads[i],NULL,worker,b) != 0)
+    { fprintf(stderr,"Unable to start worker thread\n");
+      exit(1);
+    }
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i],NULL);
+  pthread_mutex_destroy(&b->lock);
+  printf("\nC-MINUS BATCH: %d files, %d threads\n",b->count,nthreads);
+  for (i = 0; i < b->count; i++)
+    switch (b->status[i])
+    { case CompileOK:
+        ok++;
+        break;
+      case CompileErrors:
+        failed++;
+        errors += b->errors[i];
+        printf("%s: %d error(s)\n",b->files[i],b->errors[i]);
+        break;
+      case CompileNoFile:
+        missing++;
+        printf("%s: not compiled\n",b->files[i]);
+        break;
+    }
+  printf("%d compiled, %d with errors (%d errors), %d not compiled\n",
+         ok,failed,errors,missing);
+  free(b->status);
+  free(b->errors);
+  return failed + missing;
+}
+
+/* Function setStage sets StopAfter to the stage
+ * named name; it returns FALSE for an unknown name
+ */
+static int setStage(char * name)
+{ static char * names[] = {"scan", "parse", "analyze", "code"};
+  int i;
+  for (i = 0; i <= CodeStage; i++)
+    if (strcmp(name,names[i]) == 0)
+    { StopAfter = (Stage) i;
+      return TRUE;
+    }
+  return FALSE;
+}
+
+/* Function setTrace turns on the trace streams in
+ * the comma separated list, and turns off all
+ * others; "none" turns them all off. It returns
+ * FALSE for an unknown name
+ */
+static int setTrace(char * list)
+{ EchoSource = TraceScan = TraceParse = TraceAnalyze = TraceCode = FALSE;
+  while (*list != '\0')
+  { int len = strcspn(list,",");
+    if ((len == 4) && (strncmp(list,"echo",len) == 0)) EchoSource = TRUE;
+    else if ((len == 4) && (strncmp(list,"scan",len) == 0)) TraceScan = TRUE;
+    else if ((len == 5) && (strncmp(list,"parse",len) == 0)) TraceParse = TRUE;
+    else if ((len == 7) && (strncmp(list,"analyze",len) == 0)) TraceAnalyze = TRUE;
+    else if ((len == 4) && (strncmp(list,"code",len) == 0)) TraceCode = TRUE;
+    else if ((len != 4) || (strncmp(list,"none",len) != 0)) return FALSE;
+    list += len;
+    if (*list == ',') list++;
+  }
+  return TRUE;
+}
+
+/* Procedure usage describes the options and exits */
+static void usage(char * prog)
+{ fprintf(stderr,"usage: %s [options] <filename>... [@responsefile]\n",prog);
+  fprintf(stderr,"  -stop scan|parse|analyze|code  last stage to run\n");
+  fprintf(stderr,"  -trace list   trace streams: echo,scan,parse,analyze,code or none\n");
+  fprintf(stderr,"  -check        same as -stop analyze -trace none\n");
+  fprintf(stderr,"  -fold         fold constants\n");
+  fprintf(stderr,"  -regalloc     keep temporaries in registers\n");
+  fprintf(stderr,"  -peephole     optimize the TM code\n");
+  fprintf(stderr,"  -binary       write a TM object file\n");
+  fprintf(stderr,"  -j threads    compile the files on 1 to %d threads\n",MAXTHREADS);
+  fprintf(stderr,"  --time-report[=json]  report time, memory and counts per phase\n");
+  exit(1);
+}
+
+int main( int argc, char * argv[] )
+{ Batch batch;
+  int max = 0, nthreads = 0;
+  int argi = 1;
+  memset(&batch,0,sizeof(batch));
+  while ((argi < argc) && (argv[argi][0] == '-'))
+  { int hasArg = (argi + 1 < argc);
+    if (strcmp(argv[argi],"-fold") == 0) FoldConst = TRUE;
+    else if (strcmp(argv[argi],"-regalloc") == 0) RegAlloc = TRUE;
+    else if (strcmp(argv[argi],"-peephole") == 0) Peephole = TRUE;
+    else if (strcmp(argv[argi],"-binary") == 0) BinaryCode = TRUE;
+    else if (strcmp(argv[argi],"--time-report") == 0) TimeReport = TableReport;
+    else if (strcmp(argv[argi],"--time-report=json") == 0) TimeReport = JsonReport;
+    else if (strcmp(argv[argi],"-check") == 0)
+    { StopAfter = AnalyzeStage;
+      setTrace("none");
+    }
+    else if ((strcmp(argv[argi],"-stop") == 0) && hasArg)
+    { if (!setStage(argv[++argi])) usage(argv[0]);
+    }
+    else if ((strcmp(argv[argi],"-trace") == 0) && hasArg)
+    { if (!setTrace(argv[++argi])) usage(argv[0]);
+    }
+    else if ((strcmp(argv[argi],"-j") == 0) && hasArg)
+    { char * end;
+      long n = strtol(argv[++argi],&end,10);
+      if ((*end != '\0') || (end == argv[argi]) || (n < 1) || (n > MAXTHREADS))
+        usage(argv[0]);
+      nthreads = (int) n;
+    }
+    else break;
+    argi++;
+  }
+  for ( ; argi < argc; argi++)
+    if (argv[argi][0] == '@')
+      readResponseFile(&batch,argv[argi] + 1,&max);
+    else if (argv[argi][0] != '-')
+      addFile(&batch,argv[argi],&max);
+    else break;
+  if ((argi != argc) || (batch.count == 0))
+    usage(argv[0]);
+  if ((batch.count == 1) && (nthreads == 0))
+    /* a single file is listed on the screen */
+    return (compile(batch.files[0],NULL) == CompileOK) ? 0 : 1;
+  if (nthreads == 0) nthreads = 1;
+  return runBatch(&batch,nthreads) ? 1 : 0;
+}
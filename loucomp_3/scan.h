@@ -8,15 +8,37 @@
 #ifndef _SCAN_H_
 #define _SCAN_H_
 
-/* MAXTOKENLEN is the maximum size of a token */
-#define MAXTOKENLEN 40
+/* A Scanner holds all the state of scanning one
+ * source file, so that several files can be
+ * scanned at the same time
+ */
+typedef struct scanner * Scanner;
+
+/* Function newScanner returns a scanner that
+ * reads the source file f
+ */
+Scanner newScanner(FILE * f);
+
+/* Procedure freeScanner releases scanner s */
+void freeScanner(Scanner s);
 
-/* tokenString array stores the lexeme of each token */
-extern char tokenString[MAXTOKENLEN+1];
+/* function getToken returns the next token
+ * of scanner s and sets lineno to its line.
+ * For an ID or NUM it also stores a new node
+ * in *tree, unless tree is NULL: a basic node
+ * with the interned name, or a constant
+ */
+TokenType getToken(Scanner s, TreeNode ** tree);
+
+/* Function countTokens returns the number of
+ * tokens scanned by this thread so far
+ */
+long countTokens(void);
 
-/* function getToken returns the 
- * next token in source file
+/* Function tokenText returns the lexeme of the
+ * last token of scanner s; it is only valid until
+ * the next call of getToken
  */
-TokenType getToken(void);
+char * tokenText(Scanner s);
 
 #endif
@@ -2,8 +2,9 @@
 /* File: symtab.c                                   */
 /* Symbol table implementation for the TINY compiler*/
 /* (allows only one symbol table)                   */
-/* Symbol table is implemented as a chained         */
-/* hash table                                       */
+/* Each scope has an open addressing hash table    */
+/* that starts empty and grows with its load; each  */
+/* name also has a stack of its visible bindings    */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
 /****************************************************/
@@ -12,99 +13,181 @@
 #include <stdlib.h>
 #include <string.h>
 #include "symtab.h"
+#include "util.h"
 
 
-/* SIZE is the size of the hash table */
-#define SIZE 211
+/* MINSIZE is the size of a scope's hash table when
+   its first symbol is inserted; sizes are powers of
+   two and a table doubles when it is 3/4 full */
+#define MINSIZE 8
 
-/* SHIFT is the power of two used as multiplier
-   in hash function  */
-#define SHIFT 4
+/* MINBINDINGS is the first size of the binding table */
+#define MINBINDINGS 256
 
-/* the hash function */
-static int hash ( char * key )
-{ int temp = 0;
-  int i = 0;
-  while (key[i] != '\0')
-  { temp = ((temp << SHIFT) + key[i]) % SIZE;
-    ++i;
-  }
-  return temp;
-}
+/* MINCHILDREN is the first size of a child list */
+#define MINCHILDREN 4
+
+/* Symbol names are interned (see internString),
+   so their hash is precomputed and two names are
+   equal only if they are the same pointer */
 
 // pj3
 typedef enum {Variable, Function, Argument} SymK;
 const char* SymKStrings[] = {"Variable", "Function", "Argument"};
 
-/* the list of line numbers of the source 
- * code in which a variable is referenced
- */
-typedef struct LineListRec
-   { int lineno;
-     struct LineListRec * next;
-   } * LineList;
+/* MINLINES is the first size of a line array */
+#define MINLINES 4
 
-/* The record in the bucket lists for
+/* The record in the hash table for
  * each variable, including name, 
  * assigned memory location, and
  * the list of line numbers in which
- * it appears in the source code
+ * it appears in the source code.
+ * next links the symbols of a scope
+ * in order of insertion, and shadow
+ * links to the binding of the same
+ * name in an enclosing scope
  */
 typedef struct BucketListRec
    { char * name;
      SymK symbolK;
      ExpType type;    // 0:Void, 1:Integer, 2:VoidArr, 3:IntArr
      char * scope_name;
-     LineList lines;
+     int * lines;     /* line numbers of the source code */
+     int lineCount, lineMax; /* in which it is referenced */
      int memloc ; /* memory location for variable */
+     TreeNode * node; /* declaring tree node */
+     struct scopeList * scope; /* scope of the symbol */
+     struct scopeList * params; /* parameter scope of a function */
+     ExpType * argTypes; /* parameter types of a function */
+     int argCount, argMax;
      struct BucketListRec * next;
+     struct BucketListRec * shadow;
    } * BucketList;
 
+/* The binding table maps each name to the
+ * innermost visible symbol of that name, on top
+ * of the stack linked through shadow. Entries are
+ * never removed; a name that is not visible has
+ * a NULL top
+ */
+typedef struct
+   { char * name;
+     BucketList top;
+   } BindingRec;
+
+static THREADLOCAL BindingRec * bindings = NULL;
+static THREADLOCAL int bindingSize = 0;
+static THREADLOCAL int bindingCount = 0;
+
 typedef struct scopeList
   {
     char * name;
-    BucketList hashTable[SIZE];
+    BucketList * hashTable; /* NULL until the first insert */
+    int size;               /* slots in hashTable */
+    int count;              /* symbols in hashTable */
+    BucketList first, last; /* symbols in insertion order */
     struct scopeList * parent;
-    struct scopeList * child[SCPMAXCHILDREN];
+    struct scopeList ** child;
     int child_cnt;
+    int child_max;
+    struct BucketListRec * func; /* function of a parameter scope */
     int next_location;
+    int level;
   } * ScopeList;
 
 // pj3
-static ScopeList currScope;
+/* scopes and symbols made by this thread so far */
+static THREADLOCAL long scopeCount = 0;
+static THREADLOCAL long symbolCount = 0;
+
+static THREADLOCAL ScopeList currScope;
+static THREADLOCAL ScopeList globalScope;
 
 ScopeList init_currScope()
 {
-  currScope = (ScopeList) malloc(sizeof(struct scopeList));
+  // the tables of an earlier compilation went with its arenas
+  bindings = NULL;
+  bindingSize = bindingCount = 0;
+  currScope = (ScopeList) arenaAlloc(SymArena, sizeof(struct scopeList));
+  scopeCount++;
   currScope->name = "global";
   currScope->parent = NULL;
   currScope->child_cnt = 0;
   currScope->next_location = 0;
+  currScope->level = 0;
+  globalScope = currScope;
 
   return currScope;
 }
 
 
+/* Function binding returns the slot holding the
+ * top of the binding stack of name, adding an
+ * empty one if name has none yet
+ */
+static BucketList * binding( char * name )
+{ unsigned i, mask;
+  if (2 * (bindingCount + 1) > bindingSize)
+  { BindingRec * old = bindings;
+    int oldSize = bindingSize, j;
+    bindingSize = bindingSize ? 2 * bindingSize : MINBINDINGS;
+    bindings = (BindingRec *) arenaAlloc(SymArena, bindingSize * sizeof(BindingRec));
+    mask = bindingSize - 1;
+    for (j = 0; j < oldSize; j++)
+      if (old[j].name != NULL)
+      { for (i = stringHash(old[j].name) & mask; bindings[i].name != NULL; i = (i + 1) & mask)
+          ;
+        bindings[i] = old[j];
+      }
+  }
+  mask = bindingSize - 1;
+  for (i = stringHash(name) & mask; bindings[i].name != NULL; i = (i + 1) & mask)
+    if (bindings[i].name == name) return &bindings[i].top;
+  bindings[i].name = name;
+  bindingCount++;
+  return &bindings[i].top;
+} /* binding */
+
 ScopeList insert_scope(char * name)
 {
-  ScopeList newScope = (ScopeList)malloc(sizeof(struct scopeList));
+  ScopeList newScope = (ScopeList) arenaAlloc(SymArena, sizeof(struct scopeList));
+  scopeCount++;
+  // a function's scope is found from its symbol
+  BucketList f = (name != NULL) ? *binding(name) : NULL;
 
   // Generate scope name 
   if (name == NULL)
   {
-    name = (char *)malloc(100 * sizeof(char));
+    int len = snprintf(NULL, 0, "%s.%d", currScope->name, currScope->child_cnt);
+    name = (char *) arenaAlloc(StrArena, len + 1);
     sprintf(name, "%s.%d", currScope->name, currScope->child_cnt);
   }
-  else
-    newScope->name = name;
+  newScope->name = name;
 
   newScope->parent = currScope;
   newScope->child_cnt = 0;
-  newScope->next_location = 0;
+  newScope->level = currScope->level + 1;
+  // blocks inside a function continue its frame locations
+  if (currScope->parent != NULL)
+    newScope->next_location = currScope->next_location;
+  else
+    newScope->next_location = 0;
 
-  if (currScope != NULL && currScope->child_cnt < SCPMAXCHILDREN)
+  if (currScope->child_cnt == currScope->child_max)
   {
-    currScope->child[currScope->child_cnt++] = newScope;
+    int old = currScope->child_max;
+    currScope->child_max = old ? 2 * old : MINCHILDREN;
+    currScope->child = (ScopeList *) arenaGrow(SymArena, currScope->child,
+                                   old * sizeof(ScopeList),
+                                   currScope->child_max * sizeof(ScopeList));
+  }
+  currScope->child[currScope->child_cnt++] = newScope;
+
+  if ((f != NULL) && (f->symbolK == Function) && (f->scope == currScope)
+      && (f->params == NULL))
+  { f->params = newScope;
+    newScope->func = f;
   }
 
   currScope = newScope;
@@ -116,12 +199,74 @@ void exitScope()
 {
   if(currScope != NULL)
   {
+    // pop the bindings of the scope
+    for (BucketList l = currScope->first; l != NULL; l = l->next)
+      *binding(l->name) = l->shadow;
     currScope = currScope->parent;
   }
 }
 
-/* the hash table */
-// static BucketList hashTable[SIZE];
+/* Function lookup returns the symbol name of
+ * scope, or NULL if it is not there
+ */
+static BucketList lookup( ScopeList scope, char * name )
+{ unsigned i, mask;
+  BucketList l;
+  if (scope->hashTable == NULL) return NULL;
+  mask = scope->size - 1;
+  for (i = stringHash(name) & mask; (l = scope->hashTable[i]) != NULL; i = (i + 1) & mask)
+    if (l->name == name) return l;
+  return NULL;
+} /* lookup */
+
+/* Procedure place stores symbol l in the first
+ * free slot of its probe sequence
+ */
+static void place( ScopeList scope, BucketList l )
+{ unsigned mask = scope->size - 1;
+  unsigned i = stringHash(l->name) & mask;
+  while (scope->hashTable[i] != NULL) i = (i + 1) & mask;
+  scope->hashTable[i] = l;
+} /* place */
+
+/* Procedure addLine appends lineno to the line
+ * numbers of symbol l, doubling the array as needed
+ */
+static void addLine( BucketList l, int lineno )
+{ if (l->lineCount == l->lineMax)
+  { int old = l->lineMax;
+    l->lineMax = old ? 2 * old : MINLINES;
+    l->lines = (int *) arenaGrow(SymArena, l->lines,
+                          old * sizeof(int), l->lineMax * sizeof(int));
+  }
+  l->lines[l->lineCount++] = lineno;
+} /* addLine */
+
+/* Procedure enter adds the new symbol l to scope,
+ * growing the hash table when it gets 3/4 full,
+ * and pushes it on the binding stack of its name.
+ * New symbols only enter the current scope
+ */
+static void enter( ScopeList scope, BucketList l )
+{ BucketList s;
+  if (4 * (scope->count + 1) > 3 * scope->size)
+  { scope->size = scope->size ? 2 * scope->size : MINSIZE;
+    scope->hashTable = (BucketList *) arenaAlloc(SymArena, scope->size * sizeof(BucketList));
+    for (s = scope->first; s != NULL; s = s->next) place(scope, s);
+  }
+  place(scope, l);
+  scope->count++;
+  l->scope = scope;
+  l->params = NULL;
+  l->argTypes = NULL;
+  l->argCount = l->argMax = 0;
+  l->shadow = *binding(l->name);
+  *binding(l->name) = l;
+  l->next = NULL;
+  if (scope->last == NULL) scope->first = l;
+  else scope->last->next = l;
+  scope->last = l;
+} /* enter */
 
 /* Procedure st_insert inserts line numbers and
  * memory locations into the symbol table
@@ -129,61 +274,77 @@ void exitScope()
  * first time, otherwise ignored
  * 인자로 받은 scope에 insert
  * scope가 null이라면 current scope에 insert
+ * Returns the tree node that declared the symbol;
+ * a new symbol gets its memloc and level stored
+ * in that node. Arrays take one location per element
  */
-void st_insert(TreeNode * s, ScopeList scope)
+TreeNode * st_insert(TreeNode * s, ScopeList scope)
 { 
   if (scope == NULL)
     scope = currScope;
-  int h = hash(s->attr.name);
-
-  BucketList l = scope->hashTable[h];
-  while ((l != NULL) && (strcmp(s->attr.name,l->name) != 0))
-    l = l->next;
+  BucketList l = lookup(scope, s->attr.name);
 
   if (l == NULL) /* variable not yet in table */
-  { l = (BucketList) malloc(sizeof(struct BucketListRec));
+  { l = (BucketList) arenaAlloc(SymArena, sizeof(struct BucketListRec));
+    symbolCount++;
     l->name = s->attr.name;
-    l->symbolK = s->kind.decl;
+    if (s->nodekind == DeclK)
+      l->symbolK = s->kind.decl;
+    else
+      l->symbolK = (s->kind.exp == CallK) ? Function : Variable;
     l->type = s->type;
     l->scope_name = scope->name;
-    l->lines = (LineList) malloc(sizeof(struct LineListRec));
-    l->lines->lineno = s->lineno;
-    l->memloc = scope->next_location++;
-    l->lines->next = NULL;
-    l->next = scope->hashTable[h];
-    scope->hashTable[h] = l; 
+    l->lines = NULL;
+    l->lineCount = l->lineMax = 0;
+    addLine(l, s->lineno);
+    l->memloc = scope->next_location;
+    if ((s->nodekind == DeclK) && (s->kind.decl == VarDK) && (s->child[0] != NULL))
+      scope->next_location += s->child[0]->attr.val;
+    else
+      scope->next_location++;
+    l->node = s;
+    s->memloc = l->memloc;
+    s->level = scope->level;
+    enter(scope, l);
   }
   else /* found in table, so just add line number */
-  { LineList t = l->lines;
-    while (t->next != NULL) t = t->next;
-    t->next = (LineList) malloc(sizeof(struct LineListRec));
-    t->next->lineno = s->lineno;
-    t->next->next = NULL;
-  }
+    addLine(l, s->lineno);
+  return l->node;
 } /* st_insert */
 
 int insert_param(TreeNode *s, ScopeList scope)
 {
   if (scope == NULL)
     scope = currScope;
-  int h = hash(s->attr.name);
-
-  BucketList l = scope->hashTable[h];
-  while ((l != NULL) && (strcmp(s->attr.name,l->name) != 0))
-    l = l->next;
+  BucketList l = lookup(scope, s->attr.name);
 
   if (l == NULL) /* variable not yet in table */
-  { l = (BucketList) malloc(sizeof(struct BucketListRec));
+  { l = (BucketList) arenaAlloc(SymArena, sizeof(struct BucketListRec));
+    symbolCount++;
     l->name = s->attr.name;
     l->symbolK = Argument;
     l->type = s->type;
     l->scope_name = scope->name;
-    l->lines = (LineList) malloc(sizeof(struct LineListRec));
-    l->lines->lineno = s->lineno;
+    l->lines = NULL;
+    l->lineCount = l->lineMax = 0;
+    addLine(l, s->lineno);
     l->memloc = scope->next_location++;
-    l->lines->next = NULL;
-    l->next = scope->hashTable[h];
-    scope->hashTable[h] = l; 
+    l->node = s;
+    s->memloc = l->memloc;
+    s->level = scope->level;
+    enter(scope, l);
+
+    // append to the signature of the function
+    BucketList f = scope->func;
+    if (f != NULL)
+    { if (f->argCount == f->argMax)
+      { int old = f->argMax;
+        f->argMax = old ? 2 * old : MINCHILDREN;
+        f->argTypes = (ExpType *) arenaGrow(SymArena, f->argTypes,
+                                 old * sizeof(ExpType), f->argMax * sizeof(ExpType));
+      }
+      f->argTypes[f->argCount++] = l->type;
+    }
 
     return 0;
   }
@@ -197,11 +358,8 @@ int insert_param(TreeNode *s, ScopeList scope)
 // Find Symbol in current scope
 int st_lookup ( char * name )
 { 
-  int h = hash(name);
-    BucketList l = currScope->hashTable[h];
-    while ((l != NULL) && (strcmp(name, l->name) != 0))
-        l = l->next;
-    if (l != NULL) return l->memloc; 
+  BucketList l = *binding(name);
+    if ((l != NULL) && (l->scope == currScope)) return l->memloc; 
     return -1; 
 }
 /*Find Symbol including all parent scopes
@@ -209,60 +367,29 @@ int st_lookup ( char * name )
 */ 
 ScopeList st_lookup_up ( char * name )
 { 
-  int h = hash(name);
-  ScopeList scope = currScope;
-  while (scope != NULL)
-  {
-    BucketList l = scope->hashTable[h];
-    while ((l != NULL) && (strcmp(name,l->name) != 0))
-      l = l->next;
-    if (l != NULL) return scope;
-    scope = scope->parent;
-  }
-  return NULL;
+  BucketList l = *binding(name);
+  return (l != NULL) ? l->scope : NULL;
 }
-ScopeList st_lookup_down ( char * name, ScopeList scope )
-{ 
-  if (scope == NULL) {
-        return NULL; 
-    }
-
-    int h = hash(name);
-    BucketList l = scope->hashTable[h];
-    while (l != NULL) {
-        if (strcmp(name, l->name) == 0)
-            return scope; 
-        l = l->next;
-    }
-
-    for (int i = 0; i < SCPMAXCHILDREN; i++) {
-        if (scope->child[i] != NULL) {
-            ScopeList found = st_lookup_down(name, scope->child[i]);
-            if (found != NULL)
-                return found; 
-        }
-    }
-
-    return NULL; 
-}
-
-ExpType get_argType(ScopeList scope, int memloc)
+/* Function st_lookup_params returns the number of
+ * parameters of the global function name and sets
+ * *types to their types, or returns -1 if name is
+ * not a global function
+ */
+int st_lookup_params ( char * name, ExpType ** types )
 {
-  if (scope == NULL)
-    scope = currScope;
-  
-  for(int i=0; i < SIZE; i++)
-  {
-    BucketList l = scope->hashTable[i];
-    if(l == NULL)
-      continue;
-      
-    if(l->symbolK == Argument)
-      if(l->memloc == memloc)
-        return l->type;
-  }
+  BucketList l = lookup(globalScope, name);
+  if ((l == NULL) || (l->symbolK != Function))
+    return -1;
+  *types = l->argTypes;
+  return l->argCount;
+}
 
-  return -1;
+/* Procedure st_counts gives the number of scopes
+ * and symbols made by this thread so far
+ */
+void st_counts ( long * scopes, long * symbols )
+{ *scopes = scopeCount;
+  *symbols = symbolCount;
 }
 
 // pj3
@@ -279,28 +406,17 @@ void printSymTab(FILE * listing, ScopeList scope)
   fprintf(listing,"\n");
   fprintf(listing,"Symbol Name    Symbol Kind    Symbol Type    Scope Name    Location   Line Numbers\n");
   fprintf(listing,"------------   ------------   ------------   ------------  --------   ------------\n");
-  for (i=0;i<SIZE;++i)
-  { if ((l = scope->hashTable[i]) != NULL)
-    { 
-      // BucketList l =scope->hashTable[i];
-      while (l != NULL)
-      { 
-        LineList t = l->lines;
-        fprintf(listing,"%-14s ",l->name);
-        fprintf(listing,"%-14s ",SymKStrings[l->symbolK]);
-        fprintf(listing,"%-14s ",type_strings[l->type]);
-        fprintf(listing,"%-14s ",l->scope_name);
-        fprintf(listing,"%-9d  ",l->memloc);
-        while (t != NULL)
-        { fprintf(listing,"%4d ",t->lineno);
-          t = t->next;
-        }
-        fprintf(listing,"\n");
-        l = l->next;
-      }
-    }
+  for (l = scope->first; l != NULL; l = l->next)
+  { int j;
+    fprintf(listing,"%-14s ",l->name);
+    fprintf(listing,"%-14s ",SymKStrings[l->symbolK]);
+    fprintf(listing,"%-14s ",type_strings[l->type]);
+    fprintf(listing,"%-14s ",l->scope_name);
+    fprintf(listing,"%-9d  ",l->memloc);
+    for (j = 0; j < l->lineCount; j++)
+      fprintf(listing,"%4d ",l->lines[j]);
+    fprintf(listing,"\n");
   }
-  for(i=0; i < SCPMAXCHILDREN; i++)
-    if(scope->child[i] != NULL)
-      printSymTab(listing, scope->child[i]);
+  for(i=0; i < scope->child_cnt; i++)
+    printSymTab(listing, scope->child[i]);
 } /* printSymTab */
@@ -10,11 +10,12 @@
 #ifndef _SYMTAB_H_
 #define _SYMTAB_H_
 
-// pj3
-#define SCPMAXCHILDREN 100
-
 typedef struct scopeList *ScopeList;
 
+/* All symbol and scope names given to these
+ * functions must be interned (see internString)
+ */
+
 ScopeList init_currScope();
 ScopeList insert_scope(char * name);
 void exitScope();
@@ -26,7 +27,7 @@ void exitScope();
  */
 // pj3
     // current scope의 next_location 값을 이용하기 때문에 인자로 loc을 받을 필요 없음.
-void st_insert(TreeNode * s, ScopeList scope);
+TreeNode * st_insert(TreeNode * s, ScopeList scope);
 int insert_param(TreeNode *s, ScopeList scope);
 
 /* Function st_lookup returns the memory 
@@ -34,8 +35,12 @@ int insert_param(TreeNode *s, ScopeList scope);
  */
 int st_lookup ( char * name );
 ScopeList st_lookup_up ( char * name );
-ScopeList st_lookup_down ( char * name, ScopeList scope );
-ExpType get_argType(ScopeList scope, int memloc);
+int st_lookup_params ( char * name, ExpType ** types );
+
+/* Procedure st_counts gives the number of scopes
+ * and symbols made by this thread so far
+ */
+void st_counts ( long * scopes, long * symbols );
 
 /* Procedure printSymTab prints a formatted 
  * listing of the symbol table contents 
@@ -9,6 +9,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tmobj.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -18,13 +24,16 @@
 #endif
 
 /******* const *******/
-#define   IADDR_SIZE  1024 /* increase for large programs */
-#define   DADDR_SIZE  1024 /* increase for large programs */
+#define   IADDR_SIZE  1024 /* default; see -i and .imem */
+#define   DADDR_SIZE  1024 /* default; see -d and .dmem */
+#define   MAX_ADDR_SIZE  (1 << 28) /* largest memory, in words */
 #define   NO_REGS 8
 #define   PC_REG  7
 
 #define   LINESIZE  121
 #define   WORDSIZE  20
+#define   PROFDEPTH 64   /* nesting of "-> x" comments kept */
+#define   PROFSHOW  25   /* hot spots listed in the report */
 
 /******* type  *******/
 
@@ -67,9 +76,34 @@ typedef enum {
    srHALT,
    srIMEM_ERR,
    srDMEM_ERR,
-   srZERODIVIDE
+   srZERODIVIDE,
+   srIN_ERR     /* no value for an IN instruction */
    } STEPRESULT;
 
+typedef enum {
+   engSTEP,     /* decode each instruction as it is executed */
+   engTHREADED  /* run the pre-decoded threaded code */
+   } ENGINE;
+
+/* opcodes of the pre-decoded instruction form */
+typedef enum {
+   fxGENERIC,   /* executed through stepTM */
+   fxADD, fxSUB, fxMUL, fxDIV,
+   fxLD, fxST, fxLDA, fxLDC,
+   fxLDPC,      /* LD pc,d(s): indirect jump */
+   fxJLT, fxJLE, fxJGT, fxJGE, fxJEQ, fxJNE, /* target d+reg(s) */
+   fxBLT, fxBLE, fxBGT, fxBGE, fxBEQ, fxBNE, /* absolute target d */
+   fxJMP,       /* LDA pc,d(pc): absolute target d */
+   /* superinstructions; operands are read from the
+    * following entries, which keep their own decoding */
+   fxPUSHLD,    /* ST a; LD r,x; LD r2,a */
+   fxPUSHLDC,   /* ST a; LDC r,c; LD r2,a */
+   fxCMPLT, fxCMPLE, fxCMPGT, fxCMPGE, fxCMPEQ, fxCMPNE,
+                /* SUB; Jcc 2(pc); LDC 0; LDA pc,1(pc); LDC 1 */
+   fxIMEM_ERR,  /* sentinel past the end of iMem */
+   fxLim
+   } FASTOP;
+
 typedef struct {
       int iop  ;
       int iarg1  ;
@@ -77,30 +111,69 @@ typedef struct {
       int iarg3  ;
    } INSTRUCTION;
 
+typedef struct {
+      const void * handler ; /* label address when threaded */
+      int fop ;
+      int r, s, t ;
+      int d ;   /* displacement, or absolute jump target */
+   } DECODED;
+
 /******** vars ********/
 int iloc = 0 ;
 int dloc = 0 ;
 int traceflag = FALSE;
 int icountflag = FALSE;
+int batchflag = FALSE;  /* run to HALT without prompts */
+FILE * inStream = NULL;   /* IN values in batch mode */
+FILE * outStream = NULL;  /* OUT values in batch mode */
 
-INSTRUCTION iMem [IADDR_SIZE];
-int dMem [DADDR_SIZE];
+/* profiling: execution counts per location and taken
+ * counts per conditional jump, plus the innermost
+ * "-> construct" comment and the instruction's own
+ * comment from the text program
+ */
+int profflag = FALSE;
+char * profName = NULL;       /* machine-readable dump, or NULL */
+long * profCount = NULL;
+long * profTaken = NULL;
+char ** profConstruct = NULL;
+char ** profComment = NULL;
+int profNotes = 0;            /* entries in the two note arrays */
+char * profStack[PROFDEPTH];
+int profDepth = 0;
+ENGINE engine = engTHREADED;
+
+/* memory sizes are fixed at load time from the -i/-d
+ * options, the program's .imem/.dmem directives, or
+ * the defaults, in that order of precedence
+ */
+int iaddrSize = IADDR_SIZE;
+int daddrSize = DADDR_SIZE;
+int iaddrOption = 0;  /* -i, 0 if not given */
+int daddrOption = 0;  /* -d, 0 if not given */
+int iaddrHeader = 0;  /* .imem or object header, 0 if none */
+int daddrHeader = 0;  /* .dmem or object header, 0 if none */
+
+INSTRUCTION * iMem = NULL; /* allocated, or a mapped TM object */
+DECODED * xMem = NULL;     /* iaddrSize+1 entries */
+int threaded = FALSE;
+int fuseflag = FALSE;      /* fuse common sequences on load */
+int * dMem = NULL;         /* lazily committed pages */
 int reg [NO_REGS];
 
+/* RR, RM and RA opcodes, in object record order */
 char * opCodeTab[]
-        = {"HALT","IN","OUT","ADD","SUB","MUL","DIV","????",
-            /* RR opcodes */
-           "LD","ST","????", /* RM opcodes */
-           "LDA","LDC","JLT","JLE","JGT","JGE","JEQ","JNE","????"
-           /* RA opcodes */
-          };
+        = { TMOBJ_OPCODES };
+
+char * engineTab[]
+        = {"step","threaded"};
 
 char * stepResultTab[]
         = {"OK","Halted","Instruction Memory Fault",
-           "Data Memory Fault","Division by 0"
+           "Data Memory Fault","Division by 0","Input Error"
           };
 
-char pgmName[20];
+char pgmName[120];
 FILE *pgm  ;
 
 char in_Line[LINESIZE] ;
@@ -121,7 +194,7 @@ int opClass( int c )
 /********************************************/
 void writeInstruction ( int loc )
 { printf( "%5d: ", loc) ;
-  if ( (loc >= 0) && (loc < IADDR_SIZE) )
+  if ( (loc >= 0) && (loc < iaddrSize) )
   { printf("%6s%3d,", opCodeTab[iMem[loc].iop], iMem[loc].iarg1);
     switch ( opClass(iMem[loc].iop) )
     { case opclRR: printf("%1d,%1d", iMem[loc].iarg2, iMem[loc].iarg3);
@@ -209,6 +282,24 @@ int atEOL(void)
 { return ( ! nonBlank ());
 } /* atEOL */
 
+/********************************************/
+/* readLine reads a line of terminal input  */
+/* into in_Line; FALSE at end of input      */
+/********************************************/
+int readLine (void)
+{ if (fgets(in_Line, LINESIZE, stdin) == NULL)
+  { in_Line[0] = '\0';
+    lineLen = 0;
+    inCol = 0;
+    return FALSE;
+  }
+  lineLen = strlen(in_Line);
+  if ((lineLen > 0) && (in_Line[lineLen-1] == '\n'))
+    in_Line[--lineLen] = '\0';
+  inCol = 0;
+  return TRUE;
+} /* readLine */
+
 /********************************************/
 int error( char * msg, int lineNo, int instNo)
 { printf("Line %d",lineNo);
@@ -218,21 +309,132 @@ int error( char * msg, int lineNo, int instNo)
 } /* error */
 
 /********************************************/
-int readInstructions (void)
-{ OPCODE op;
-  int arg1, arg2, arg3;
-  int loc, regNo, lineNo;
+/* allocDMem maps daddrSize words of data   */
+/* memory; pages are only committed when    */
+/* first touched, so a large address space  */
+/* costs nothing until the program uses it  */
+/********************************************/
+int allocDMem (void)
+{ size_t len;
+  daddrSize = daddrOption ? daddrOption
+            : daddrHeader ? daddrHeader : DADDR_SIZE;
+  len = (size_t) daddrSize * sizeof(int);
+  dMem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (dMem == MAP_FAILED)
+  { dMem = NULL;
+    return error("Cannot allocate data memory", 0, -1);
+  }
+  return TRUE;
+} /* allocDMem */
+
+/********************************************/
+/* clearMachine resets the registers and    */
+/* replaces dMem with fresh zero pages      */
+/* rather than writing every word           */
+/********************************************/
+void clearMachine (void)
+{ int regNo;
   for (regNo = 0 ; regNo < NO_REGS ; regNo++)
       reg[regNo] = 0 ;
-  dMem[0] = DADDR_SIZE - 1 ;
-  for (loc = 1 ; loc < DADDR_SIZE ; loc++)
-      dMem[loc] = 0 ;
-  for (loc = 0 ; loc < IADDR_SIZE ; loc++)
-  { iMem[loc].iop = opHALT ;
-    iMem[loc].iarg1 = 0 ;
-    iMem[loc].iarg2 = 0 ;
-    iMem[loc].iarg3 = 0 ;
+  if (mmap(dMem, (size_t) daddrSize * sizeof(int), PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+           -1, 0) == MAP_FAILED)
+    memset(dMem, 0, (size_t) daddrSize * sizeof(int));
+  dMem[0] = daddrSize - 1 ;
+} /* clearMachine */
+
+/********************************************/
+/* growIMem makes iMem hold at least size   */
+/* locations; new locations are HALT 0,0,0  */
+/********************************************/
+int growIMem (int size)
+{ INSTRUCTION * p;
+  int newSize = iaddrSize;
+  if (size <= iaddrSize) return TRUE;
+  while (newSize < size) newSize *= 2;
+  if (newSize > MAX_ADDR_SIZE) newSize = MAX_ADDR_SIZE;
+  p = (INSTRUCTION *) realloc(iMem, newSize * sizeof(INSTRUCTION));
+  if (p == NULL) return FALSE;
+  memset(p + iaddrSize, 0, (newSize - iaddrSize) * sizeof(INSTRUCTION));
+  iMem = p;
+  iaddrSize = newSize;
+  return TRUE;
+} /* growIMem */
+
+/********************************************/
+/* readDirective handles a ".imem n" or     */
+/* ".dmem n" comment line of a text program */
+/********************************************/
+void readDirective (void)
+{ if ( ! skipCh('.') || ! getWord () || ! getNum () || (num <= 0)
+       || (num > MAX_ADDR_SIZE) )
+    return;
+  if (strcmp(word, "dmem") == 0) daddrHeader = num;
+  else if (strcmp(word, "imem") == 0)
+  { iaddrHeader = num;
+    if (! iaddrOption) growIMem(num);
+  }
+} /* readDirective */
+
+/********************************************/
+/* noteInstruction records the construct    */
+/* and comment of location loc for the      */
+/* profile report                           */
+/********************************************/
+void noteInstruction (int loc, char * comment)
+{ int i, n;
+  if (loc >= profNotes)
+  { n = (iaddrSize > loc) ? iaddrSize : loc + 1;
+    profConstruct = (char **) realloc(profConstruct, n * sizeof(char *));
+    profComment = (char **) realloc(profComment, n * sizeof(char *));
+    if ((profConstruct == NULL) || (profComment == NULL))
+    { printf("Out of memory recording profile notes\n");
+      exit(1);
+    }
+    for (i = profNotes ; i < n ; i++)
+      profConstruct[i] = profComment[i] = NULL;
+    profNotes = n;
   }
+  if (profDepth > 0)
+    profConstruct[loc] = profStack[(profDepth > PROFDEPTH)
+                                   ? PROFDEPTH - 1 : profDepth - 1];
+  while ((*comment == ' ') || (*comment == '\t')) comment++;
+  if (*comment != '\0') profComment[loc] = strdup(comment);
+} /* noteInstruction */
+
+/********************************************/
+/* readComment handles a "*" line of a text */
+/* program: directives, and the "-> x" and  */
+/* "<- x" brackets cgen emits around code   */
+/********************************************/
+void readComment (void)
+{ char * text;
+  if ( nonBlank () && (ch == '.') )
+  { readDirective ();
+    return;
+  }
+  if ( ! profflag ) return;
+  text = in_Line + inCol;
+  if (strncmp(text, "->", 2) == 0)
+  { text += 2;
+    while (*text == ' ') text++;
+    if (profDepth < PROFDEPTH) profStack[profDepth] = strdup(text);
+    profDepth++;
+  }
+  else if ((strncmp(text, "<-", 2) == 0) && (profDepth > 0))
+    profDepth--;
+} /* readComment */
+
+/********************************************/
+int readInstructions (void)
+{ OPCODE op;
+  int arg1, arg2, arg3;
+  int loc, lineNo;
+  iaddrSize = iaddrOption ? iaddrOption : IADDR_SIZE;
+  iMem = (INSTRUCTION *) calloc(iaddrSize, sizeof(INSTRUCTION));
+  if (iMem == NULL)
+    return error("Cannot allocate instruction memory", 0, -1);
   lineNo = 0 ;
   while (! feof(pgm))
   { fgets( in_Line, LINESIZE-2, pgm  ) ;
@@ -241,11 +443,16 @@ int readInstructions (void)
     lineLen = strlen(in_Line)-1 ;
     if (in_Line[lineLen]=='\n') in_Line[lineLen] = '\0' ;
     else in_Line[++lineLen] = '\0';
-    if ( (nonBlank()) && (in_Line[inCol] != '*') )
+    if ( skipCh('*') )
+      readComment ();
+    else if ( nonBlank() )
     { if (! getNum())
         return error("Bad location", lineNo,-1);
       loc = num;
-      if (loc > IADDR_SIZE)
+      if (loc < 0)
+        return error("Bad location", lineNo,loc);
+      if ( (loc >= iaddrSize)
+           && (iaddrOption || (loc >= MAX_ADDR_SIZE) || ! growIMem(loc + 1)) )
         return error("Location too large",lineNo,loc);
       if (! skipCh(':'))
         return error("Missing colon", lineNo,loc);
@@ -297,13 +504,147 @@ int readInstructions (void)
       iMem[loc].iarg1 = arg1;
       iMem[loc].iarg2 = arg2;
       iMem[loc].iarg3 = arg3;
+      if ( profflag )
+      { if ( skipCh(')') ) nonBlank ();
+        noteInstruction (loc, in_Line + ((inCol < lineLen) ? inCol : lineLen));
+      }
     }
   }
   return TRUE;
 } /* readInstructions */
 
+/********************************************/
+/* checkInstruction validates one decoded   */
+/* instruction as readInstructions would    */
+/********************************************/
+int checkInstruction (INSTRUCTION * in)
+{ if ( (in->iop < 0) || (in->iop >= opRALim)
+       || (in->iop == opRRLim) || (in->iop == opRMLim) )
+    return FALSE;
+  if ( (in->iarg1 < 0) || (in->iarg1 >= NO_REGS)
+       || (in->iarg3 < 0) || (in->iarg3 >= NO_REGS) )
+    return FALSE;
+  if ( (opClass(in->iop) == opclRR)
+       && ((in->iarg2 < 0) || (in->iarg2 >= NO_REGS)) )
+    return FALSE;
+  return TRUE;
+} /* checkInstruction */
+
+/********************************************/
+/* mapInstructions loads a TM object file   */
+/* by mapping it directly behind iMem; the  */
+/* rest of iMem is zero pages, i.e. HALT    */
+/********************************************/
+int mapInstructions (void)
+{ struct stat st;
+  TMOBJHEADER hdr;
+  char * base;
+  size_t len;
+  int fd, loc;
+  fd = open(pgmName, O_RDONLY);
+  if ( (fd < 0) || (fstat(fd, &st) < 0) )
+    return error("Cannot open object file", 0, -1);
+  if ( pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr) )
+  { close(fd);
+    return error("Bad object file size", 0, -1);
+  }
+  if ( (memcmp(hdr.magic, TMOBJ_MAGIC, sizeof(hdr.magic)) != 0)
+       || (hdr.version != TMOBJ_VERSION) || (hdr.size < 0)
+       || (hdr.size > MAX_ADDR_SIZE) || (hdr.dsize < 0)
+       || (hdr.dsize > MAX_ADDR_SIZE) )
+  { close(fd);
+    return error("Bad object file header", 0, -1);
+  }
+  daddrHeader = hdr.dsize;
+  iaddrSize = iaddrOption ? iaddrOption
+            : (hdr.size > IADDR_SIZE) ? hdr.size : IADDR_SIZE;
+  len = sizeof(TMOBJHEADER) + (size_t) iaddrSize * sizeof(INSTRUCTION);
+  if ( st.st_size != (off_t) (sizeof(TMOBJHEADER)
+                              + (size_t) hdr.size * sizeof(INSTRUCTION)) )
+  { close(fd);
+    return error("Bad object file size", 0, -1);
+  }
+  if ( hdr.size > iaddrSize )
+  { close(fd);
+    return error("Program does not fit in instruction memory (see -i)", 0, -1);
+  }
+  base = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if ( (base == MAP_FAILED)
+       || (mmap(base, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+                fd, 0) == MAP_FAILED) )
+  { close(fd);
+    return error("Cannot map object file", 0, -1);
+  }
+  close(fd);
+  iMem = (INSTRUCTION *) (base + sizeof(TMOBJHEADER));
+  for (loc = 0 ; loc < hdr.size ; loc++)
+    if (! checkInstruction(&iMem[loc]))
+      return error("Illegal instruction in object file", 0, loc);
+  return TRUE;
+} /* mapInstructions */
+
+/********************************************/
+/* programSize returns one past the last    */
+/* location that is not HALT 0,0,0          */
+/********************************************/
+int programSize (void)
+{ int size = iaddrSize;
+  while ( (size > 0) && (iMem[size-1].iop == opHALT)
+          && (iMem[size-1].iarg1 == 0) && (iMem[size-1].iarg2 == 0)
+          && (iMem[size-1].iarg3 == 0) )
+    size--;
+  return size;
+} /* programSize */
+
+/********************************************/
+/* writeObject writes the loaded program    */
+/* as a TM object file                      */
+/********************************************/
+int writeObject (char * fileName)
+{ TMOBJHEADER h;
+  FILE * out = fopen(fileName, "wb");
+  if (out == NULL)
+    return error("Cannot create output file", 0, -1);
+  memcpy(h.magic, TMOBJ_MAGIC, sizeof(h.magic));
+  h.version = TMOBJ_VERSION;
+  h.size = programSize();
+  h.dsize = daddrHeader;
+  fwrite(&h, sizeof(h), 1, out);
+  fwrite(iMem, sizeof(INSTRUCTION), h.size, out);
+  return (fclose(out) == 0);
+} /* writeObject */
+
+/********************************************/
+/* writeText writes the loaded program in   */
+/* the TM text format that code.c emits     */
+/********************************************/
+int writeText (char * fileName)
+{ int loc, size;
+  FILE * out = fopen(fileName, "w");
+  if (out == NULL)
+    return error("Cannot create output file", 0, -1);
+  size = programSize();
+  if (iaddrHeader > 0) fprintf(out, "* .imem %d\n", iaddrHeader);
+  if (daddrHeader > 0) fprintf(out, "* .dmem %d\n", daddrHeader);
+  for (loc = 0 ; loc < size ; loc++)
+  { INSTRUCTION * in = &iMem[loc];
+    if (opClass(in->iop) == opclRR)
+      fprintf(out, "%3d:  %5s  %d,%d,%d \n", loc, opCodeTab[in->iop],
+              in->iarg1, in->iarg2, in->iarg3);
+    else
+      fprintf(out, "%3d:  %5s  %d,%d(%d) \n", loc, opCodeTab[in->iop],
+              in->iarg1, in->iarg2, in->iarg3);
+  }
+  return (fclose(out) == 0);
+} /* writeText */
+
 
 /********************************************/
+/* TAKE performs a conditional jump, and    */
+/* counts it as taken when profiling        */
+#define TAKE(a) do { reg[PC_REG] = (a) ; \
+                     if ( profflag ) profTaken[pc]++ ; } while (0)
+
 STEPRESULT stepTM (void)
 { INSTRUCTION currentinstruction  ;
   int pc  ;
@@ -311,9 +652,10 @@ STEPRESULT stepTM (void)
   int ok ;
 
   pc = reg[PC_REG] ;
-  if ( (pc < 0) || (pc > IADDR_SIZE)  )
+  if ( (unsigned) pc >= (unsigned) iaddrSize )
       return srIMEM_ERR ;
   reg[PC_REG] = pc + 1 ;
+  if ( profflag ) profCount[pc]++ ;
   currentinstruction = iMem[ pc ] ;
   switch (opClass(currentinstruction.iop) )
   { case opclRR :
@@ -328,7 +670,7 @@ STEPRESULT stepTM (void)
       r = currentinstruction.iarg1 ;
       s = currentinstruction.iarg3 ;
       m = currentinstruction.iarg2 + reg[s] ;
-      if ( (m < 0) || (m > DADDR_SIZE))
+      if ( (unsigned) m >= (unsigned) daddrSize )
          return srDMEM_ERR ;
       break;
 
@@ -344,19 +686,20 @@ STEPRESULT stepTM (void)
   { /* RR instructions */
     case opHALT :
     /***********************************/
-      printf("HALT: %1d,%1d,%1d\n",r,s,t);
+      if ( ! batchflag ) printf("HALT: %1d,%1d,%1d\n",r,s,t);
       return srHALT ;
       /* break; */
 
     case opIN :
     /***********************************/
+      if ( batchflag )
+      { if ( fscanf(inStream, "%d", &reg[r]) != 1 ) return srIN_ERR ;
+        break;
+      }
       do
       { printf("Enter value for IN instruction: ") ;
-        fflush (stdin);
         fflush (stdout);
-        gets(in_Line);
-        lineLen = strlen(in_Line) ;
-        inCol = 0;
+        if ( ! readLine () ) return srIN_ERR ;
         ok = getNum();
         if ( ! ok ) printf ("Illegal value\n");
         else reg[r] = num;
@@ -365,7 +708,8 @@ STEPRESULT stepTM (void)
       break;
 
     case opOUT :  
-      printf ("OUT instruction prints: %d\n", reg[r] ) ;
+      if ( batchflag ) fprintf (outStream, "%d\n", reg[r] ) ;
+      else printf ("OUT instruction prints: %d\n", reg[r] ) ;
       break;
     case opADD :  reg[r] = reg[s] + reg[t] ;  break;
     case opSUB :  reg[r] = reg[s] - reg[t] ;  break;
@@ -384,17 +728,434 @@ STEPRESULT stepTM (void)
     /*************** RA instructions ********************/
     case opLDA :    reg[r] = m ; break;
     case opLDC :    reg[r] = currentinstruction.iarg2 ;   break;
-    case opJLT :    if ( reg[r] <  0 ) reg[PC_REG] = m ; break;
-    case opJLE :    if ( reg[r] <=  0 ) reg[PC_REG] = m ; break;
-    case opJGT :    if ( reg[r] >  0 ) reg[PC_REG] = m ; break;
-    case opJGE :    if ( reg[r] >=  0 ) reg[PC_REG] = m ; break;
-    case opJEQ :    if ( reg[r] == 0 ) reg[PC_REG] = m ; break;
-    case opJNE :    if ( reg[r] != 0 ) reg[PC_REG] = m ; break;
+    case opJLT :    if ( reg[r] <  0 ) TAKE(m) ; break;
+    case opJLE :    if ( reg[r] <=  0 ) TAKE(m) ; break;
+    case opJGT :    if ( reg[r] >  0 ) TAKE(m) ; break;
+    case opJGE :    if ( reg[r] >=  0 ) TAKE(m) ; break;
+    case opJEQ :    if ( reg[r] == 0 ) TAKE(m) ; break;
+    case opJNE :    if ( reg[r] != 0 ) TAKE(m) ; break;
 
     /* end of legal instructions */
   } /* case */
   return srOKAY ;
 } /* stepTM */
+#undef TAKE
+
+/********************************************/
+/* decodeInstructions translates iMem into  */
+/* xMem once, after the program is loaded.  */
+/* Anything that reads or writes the pc in  */
+/* an unusual way is left to stepTM.        */
+/********************************************/
+void decodeInstructions (void)
+{ int loc, r, s, t, d, a;
+  DECODED * x;
+  free(xMem);
+  xMem = (DECODED *) calloc(iaddrSize + 1, sizeof(DECODED));
+  if (xMem == NULL)
+  { printf("Out of memory decoding instructions\n");
+    exit(1);
+  }
+  for (loc = 0 ; loc < iaddrSize ; loc++)
+  { x = &xMem[loc] ;
+    r = iMem[loc].iarg1 ;
+    x->fop = fxGENERIC ;
+    x->r = r ;
+    switch (opClass(iMem[loc].iop))
+    { case opclRR :
+        s = iMem[loc].iarg2 ;
+        t = iMem[loc].iarg3 ;
+        x->s = s ;
+        x->t = t ;
+        x->d = 0 ;
+        if ((r == PC_REG) || (s == PC_REG) || (t == PC_REG)) break ;
+        switch (iMem[loc].iop)
+        { case opADD : x->fop = fxADD ; break ;
+          case opSUB : x->fop = fxSUB ; break ;
+          case opMUL : x->fop = fxMUL ; break ;
+          case opDIV : x->fop = fxDIV ; break ;
+          default : break ; /* HALT, IN, OUT */
+        }
+        break ;
+
+      default :
+        s = iMem[loc].iarg3 ;
+        d = iMem[loc].iarg2 ;
+        a = loc + 1 + d ;  /* target when s is the pc */
+        x->s = s ;
+        x->t = 0 ;
+        x->d = d ;
+        if (s == PC_REG)
+        { x->d = a ;
+          if ((a < 0) || (a >= iaddrSize)) break ;
+        }
+        switch (iMem[loc].iop)
+        { case opLD :
+            if (s == PC_REG) break ;
+            x->fop = (r == PC_REG) ? fxLDPC : fxLD ;
+            break ;
+          case opST :
+            if ((r != PC_REG) && (s != PC_REG)) x->fop = fxST ;
+            break ;
+          case opLDA :
+            if (r == PC_REG) { if (s == PC_REG) x->fop = fxJMP ; }
+            else x->fop = (s == PC_REG) ? fxLDC : fxLDA ;
+            break ;
+          case opLDC :
+            x->d = d ;
+            if (r != PC_REG) x->fop = fxLDC ;
+            break ;
+          case opJLT : case opJLE : case opJGT :
+          case opJGE : case opJEQ : case opJNE :
+            if (r == PC_REG) break ;
+            x->fop = iMem[loc].iop - opJLT
+                   + ((s == PC_REG) ? fxBLT : fxJLT) ;
+            break ;
+          default : break ;
+        }
+        break ;
+    }
+  }
+  /* when profiling every instruction goes through
+   * stepTM, which does the counting
+   */
+  if ( profflag )
+    for (loc = 0 ; loc < iaddrSize ; loc++)
+      xMem[loc].fop = fxGENERIC ;
+  xMem[iaddrSize].fop = fxIMEM_ERR ;
+  threaded = FALSE ;
+} /* decodeInstructions */
+
+/********************************************/
+/* fuseInstructions replaces the first      */
+/* entry of common cgen sequences in xMem   */
+/* with a superinstruction and returns the  */
+/* number of sequences fused. Registers,    */
+/* memory and instruction counts are as if  */
+/* the sequence ran one by one, and jumps   */
+/* into its middle still work              */
+/********************************************/
+int fuseInstructions (void)
+{ int loc, fused = 0;
+  DECODED * x;
+  for (loc = 0 ; loc < iaddrSize ; loc++)
+  { x = &xMem[loc] ;
+    /* spill and reload of the left operand of an OpK:
+     * ST r,k(b); LD/LDC r1,...; LD r2,k(b) */
+    if ( (x->fop == fxST) && (loc + 3 <= iaddrSize)
+         && (x[2].fop == fxLD) && (x[2].s == x->s) && (x[2].d == x->d)
+         && (x[1].r != x->s) )
+    { if (x[1].fop == fxLD) { x->fop = fxPUSHLD ; fused++ ; }
+      else if (x[1].fop == fxLDC) { x->fop = fxPUSHLDC ; fused++ ; }
+    }
+    /* comparison idiom: SUB r,s,t; Jcc r,2(pc);
+     * LDC r1,0; LDA pc,1(pc); LDC r1,1 */
+    else if ( (x->fop == fxSUB) && (loc + 5 <= iaddrSize)
+              && (x[1].fop >= fxBLT) && (x[1].fop <= fxBNE)
+              && (x[1].r == x->r) && (x[1].d == loc + 4)
+              && (x[2].fop == fxLDC) && (x[2].d == 0)
+              && (x[3].fop == fxJMP) && (x[3].d == loc + 5)
+              && (x[4].fop == fxLDC) && (x[4].d == 1)
+              && (x[4].r == x[2].r) )
+    { x->fop = fxCMPLT + (x[1].fop - fxBLT) ;
+      fused++ ;
+    }
+  }
+  threaded = FALSE ;
+  return fused ;
+} /* fuseInstructions */
+
+/********************************************/
+/* runThreaded executes xMem from the       */
+/* current pc until a step result other     */
+/* than srOKAY; *cnt receives the number    */
+/* of instructions executed, counted the    */
+/* same way as the step engine counts them  */
+/********************************************/
+#if defined(__GNUC__) && !defined(TM_NO_COMPUTED_GOTO)
+#define THREADED_CODE
+#endif
+
+STEPRESULT runThreaded (int * cnt)
+{ register DECODED * ip ;
+  register int * rg = reg ;
+  register int * dm = dMem ;
+  const unsigned isize = iaddrSize ;
+  const unsigned dsize = daddrSize ;
+  int n = 0 ;
+  int m, a ;
+  STEPRESULT result ;
+
+#ifdef THREADED_CODE
+  static const void * labels[fxLim] =
+    { &&L_fxGENERIC, &&L_fxADD, &&L_fxSUB, &&L_fxMUL, &&L_fxDIV,
+      &&L_fxLD, &&L_fxST, &&L_fxLDA, &&L_fxLDC, &&L_fxLDPC,
+      &&L_fxJLT, &&L_fxJLE, &&L_fxJGT, &&L_fxJGE, &&L_fxJEQ, &&L_fxJNE,
+      &&L_fxBLT, &&L_fxBLE, &&L_fxBGT, &&L_fxBGE, &&L_fxBEQ, &&L_fxBNE,
+      &&L_fxJMP, &&L_fxPUSHLD, &&L_fxPUSHLDC,
+      &&L_fxCMPLT, &&L_fxCMPLE, &&L_fxCMPGT, &&L_fxCMPGE,
+      &&L_fxCMPEQ, &&L_fxCMPNE, &&L_fxIMEM_ERR };
+  if (! threaded)
+  { for (m = 0 ; m <= iaddrSize ; m++)
+      xMem[m].handler = labels[xMem[m].fop] ;
+    threaded = TRUE ;
+  }
+#define CASE(op)    L_##op
+#define DISPATCH()  do { n++ ; goto *ip->handler ; } while (0)
+#else
+#define CASE(op)    case op
+#define DISPATCH()  goto dispatch
+#endif
+
+/* JUMP transfers control; a bad target faults on the next fetch */
+#define JUMP(a) \
+  do { m = (a) ; \
+       if ((unsigned) m >= isize) \
+       { rg[PC_REG] = m ; n++ ; result = srIMEM_ERR ; goto done ; } \
+       ip = &xMem[m] ; DISPATCH() ; } while (0)
+#define NEXT()      do { ip++ ; DISPATCH() ; } while (0)
+#define FAULT(res)  do { rg[PC_REG] = (ip - xMem) + 1 ; \
+                         result = (res) ; goto done ; } while (0)
+#define EA()        do { m = ip->d + rg[ip->s] ; \
+                         if ((unsigned) m >= dsize) \
+                           FAULT(srDMEM_ERR) ; } while (0)
+/* CMP finishes a fused comparison: 3 instructions
+ * executed when the jump is taken, 4 when not */
+#define CMP(rel)    do { m = rg[ip->s] - rg[ip->t] ; rg[ip->r] = m ; \
+                         if (m rel 0) { rg[ip[2].r] = 1 ; n += 2 ; } \
+                         else { rg[ip[2].r] = 0 ; n += 3 ; } \
+                         ip += 5 ; DISPATCH() ; } while (0)
+
+  JUMP(rg[PC_REG]) ;
+#ifndef THREADED_CODE
+dispatch:
+  n++ ;
+  switch (ip->fop)
+  {
+#endif
+      CASE(fxGENERIC):
+        rg[PC_REG] = ip - xMem ;
+        result = stepTM () ;
+        if (result != srOKAY) goto done ;
+        JUMP(rg[PC_REG]) ;
+      CASE(fxADD): rg[ip->r] = rg[ip->s] + rg[ip->t] ; NEXT() ;
+      CASE(fxSUB): rg[ip->r] = rg[ip->s] - rg[ip->t] ; NEXT() ;
+      CASE(fxMUL): rg[ip->r] = rg[ip->s] * rg[ip->t] ; NEXT() ;
+      CASE(fxDIV):
+        if (rg[ip->t] == 0) FAULT(srZERODIVIDE) ;
+        rg[ip->r] = rg[ip->s] / rg[ip->t] ;
+        NEXT() ;
+      CASE(fxLD):  EA() ; rg[ip->r] = dm[m] ; NEXT() ;
+      CASE(fxST):  EA() ; dm[m] = rg[ip->r] ; NEXT() ;
+      CASE(fxLDA): rg[ip->r] = ip->d + rg[ip->s] ; NEXT() ;
+      CASE(fxLDC): rg[ip->r] = ip->d ; NEXT() ;
+      CASE(fxLDPC): EA() ; JUMP(dm[m]) ;
+      CASE(fxJLT): if (rg[ip->r] <  0) JUMP(ip->d + rg[ip->s]) ; NEXT() ;
+      CASE(fxJLE): if (rg[ip->r] <= 0) JUMP(ip->d + rg[ip->s]) ; NEXT() ;
+      CASE(fxJGT): if (rg[ip->r] >  0) JUMP(ip->d + rg[ip->s]) ; NEXT() ;
+      CASE(fxJGE): if (rg[ip->r] >= 0) JUMP(ip->d + rg[ip->s]) ; NEXT() ;
+      CASE(fxJEQ): if (rg[ip->r] == 0) JUMP(ip->d + rg[ip->s]) ; NEXT() ;
+      CASE(fxJNE): if (rg[ip->r] != 0) JUMP(ip->d + rg[ip->s]) ; NEXT() ;
+      CASE(fxBLT): if (rg[ip->r] <  0) { ip = &xMem[ip->d] ; DISPATCH() ; } NEXT() ;
+      CASE(fxBLE): if (rg[ip->r] <= 0) { ip = &xMem[ip->d] ; DISPATCH() ; } NEXT() ;
+      CASE(fxBGT): if (rg[ip->r] >  0) { ip = &xMem[ip->d] ; DISPATCH() ; } NEXT() ;
+      CASE(fxBGE): if (rg[ip->r] >= 0) { ip = &xMem[ip->d] ; DISPATCH() ; } NEXT() ;
+      CASE(fxBEQ): if (rg[ip->r] == 0) { ip = &xMem[ip->d] ; DISPATCH() ; } NEXT() ;
+      CASE(fxBNE): if (rg[ip->r] != 0) { ip = &xMem[ip->d] ; DISPATCH() ; } NEXT() ;
+      CASE(fxJMP): ip = &xMem[ip->d] ; DISPATCH() ;
+      CASE(fxPUSHLD):
+        EA() ; dm[m] = rg[ip->r] ; a = m ;
+        ip++ ; n++ ;
+        EA() ; rg[ip->r] = dm[m] ;
+        ip++ ; n++ ;
+        rg[ip->r] = dm[a] ;
+        NEXT() ;
+      CASE(fxPUSHLDC):
+        EA() ; dm[m] = rg[ip->r] ;
+        rg[ip[1].r] = ip[1].d ;
+        ip += 2 ; n += 2 ;
+        rg[ip->r] = dm[m] ;
+        NEXT() ;
+      CASE(fxCMPLT): CMP(<) ;
+      CASE(fxCMPLE): CMP(<=) ;
+      CASE(fxCMPGT): CMP(>) ;
+      CASE(fxCMPGE): CMP(>=) ;
+      CASE(fxCMPEQ): CMP(==) ;
+      CASE(fxCMPNE): CMP(!=) ;
+      CASE(fxIMEM_ERR):
+        rg[PC_REG] = isize ;
+        result = srIMEM_ERR ;
+        goto done ;
+#ifndef THREADED_CODE
+      default :
+        rg[PC_REG] = ip - xMem ;
+        result = srIMEM_ERR ;
+        goto done ;
+  }
+#endif
+done:
+  *cnt = n ;
+  return result ;
+#undef CASE
+#undef DISPATCH
+#undef JUMP
+#undef NEXT
+#undef FAULT
+#undef EA
+#undef CMP
+} /* runThreaded */
+
+/********************************************/
+/* clearProfile allocates or zeroes the     */
+/* profile counters                         */
+/********************************************/
+void clearProfile (void)
+{ if ( profCount == NULL )
+  { profCount = (long *) calloc(iaddrSize, sizeof(long));
+    profTaken = (long *) calloc(iaddrSize, sizeof(long));
+    if ((profCount == NULL) || (profTaken == NULL))
+    { printf("Out of memory for profile counters\n");
+      exit(1);
+    }
+  }
+  else
+  { memset(profCount, 0, iaddrSize * sizeof(long));
+    memset(profTaken, 0, iaddrSize * sizeof(long));
+  }
+} /* clearProfile */
+
+/* profile annotations of a location, "" if none */
+#define PROFCONSTRUCT(loc) \
+  (((loc) < profNotes) && profConstruct[loc] ? profConstruct[loc] : "")
+#define PROFCOMMENT(loc) \
+  (((loc) < profNotes) && profComment[loc] ? profComment[loc] : "")
+
+static int isJump (int op)
+{ return (op >= opJLT) && (op <= opJNE); }
+
+/* orders locations by decreasing count */
+static int compareCounts (const void * a, const void * b)
+{ long ca = profCount[*(const int *) a];
+  long cb = profCount[*(const int *) b];
+  if (ca != cb) return (ca < cb) ? 1 : -1;
+  return *(const int *) a - *(const int *) b;
+}
+
+/********************************************/
+/* printProfile writes the hot-spot report: */
+/* hottest locations, counts per opcode,    */
+/* branch behaviour and time per construct  */
+/********************************************/
+void printProfile (FILE * out)
+{ long total = 0, opCount[opRALim+1];
+  int * hot, nhot = 0, loc, i, j, nc = 0;
+  char ** cname;
+  long * ccount;
+  if (profCount == NULL) return;
+  memset(opCount, 0, sizeof(opCount));
+  hot = (int *) malloc(iaddrSize * sizeof(int));
+  cname = (char **) malloc((iaddrSize + 1) * sizeof(char *));
+  ccount = (long *) malloc((iaddrSize + 1) * sizeof(long));
+  if ((hot == NULL) || (cname == NULL) || (ccount == NULL))
+  { printf("Out of memory for profile report\n");
+    return;
+  }
+  for (loc = 0 ; loc < iaddrSize ; loc++)
+    if (profCount[loc] > 0)
+    { char * c = PROFCONSTRUCT(loc);
+      hot[nhot++] = loc;
+      total += profCount[loc];
+      opCount[iMem[loc].iop] += profCount[loc];
+      for (j = 0 ; (j < nc) && (strcmp(cname[j], c) != 0) ; j++) ;
+      if (j == nc) { cname[nc] = c; ccount[nc++] = 0; }
+      ccount[j] += profCount[loc];
+    }
+  qsort(hot, nhot, sizeof(int), compareCounts);
+  fprintf(out,"\nProfile: %ld instructions executed at %d locations\n",
+          total, nhot);
+  if (total == 0) total = 1;
+
+  fprintf(out,"\nHot spots:\n");
+  fprintf(out,"  loc        count      %%  instruction        construct / comment\n");
+  for (i = 0 ; (i < nhot) && (i < PROFSHOW) ; i++)
+  { INSTRUCTION * in = &iMem[hot[i]];
+    char buf[40];
+    if (opClass(in->iop) == opclRR)
+      sprintf(buf, "%-5s %d,%d,%d", opCodeTab[in->iop],
+              in->iarg1, in->iarg2, in->iarg3);
+    else
+      sprintf(buf, "%-5s %d,%d(%d)", opCodeTab[in->iop],
+              in->iarg1, in->iarg2, in->iarg3);
+    fprintf(out,"%5d %12ld %6.2f  %-18s %s%s%s\n", hot[i], profCount[hot[i]],
+            100.0 * profCount[hot[i]] / total, buf, PROFCONSTRUCT(hot[i]),
+            *PROFCOMMENT(hot[i]) ? " / " : "", PROFCOMMENT(hot[i]));
+  }
+
+  fprintf(out,"\nOpcodes:\n");
+  for (i = 0 ; i < opRALim ; i++)
+    if (opCount[i] > 0)
+      fprintf(out,"  %-5s %12ld %6.2f\n", opCodeTab[i], opCount[i],
+              100.0 * opCount[i] / total);
+
+  fprintf(out,"\nBranches:\n");
+  fprintf(out,"  loc  op           taken    not taken  construct\n");
+  for (i = 0, j = 0 ; (i < nhot) && (j < PROFSHOW) ; i++)
+    if (isJump(iMem[hot[i]].iop))
+    { loc = hot[i];
+      fprintf(out,"%5d  %-4s %12ld %12ld  %s\n", loc, opCodeTab[iMem[loc].iop],
+              profTaken[loc], profCount[loc] - profTaken[loc],
+              PROFCONSTRUCT(loc));
+      j++;
+    }
+
+  fprintf(out,"\nConstructs:\n");
+  for (i = 1 ; i < nc ; i++)  /* insertion sort, few entries */
+  { char * n = cname[i];
+    long c = ccount[i];
+    for (j = i ; (j > 0) && (ccount[j-1] < c) ; j--)
+    { cname[j] = cname[j-1];
+      ccount[j] = ccount[j-1];
+    }
+    cname[j] = n;
+    ccount[j] = c;
+  }
+  for (i = 0 ; i < nc ; i++)
+    fprintf(out,"  %-30s %12ld %6.2f\n", *cname[i] ? cname[i] : "(none)",
+            ccount[i], 100.0 * ccount[i] / total);
+  free(hot);
+  free(cname);
+  free(ccount);
+} /* printProfile */
+
+/********************************************/
+/* dumpProfile writes every executed        */
+/* location as a tab-separated record       */
+/********************************************/
+int dumpProfile (char * fileName)
+{ int loc;
+  FILE * out = fopen(fileName, "w");
+  if (out == NULL)
+    return error("Cannot create profile file", 0, -1);
+  fprintf(out, "loc\top\tr\targ2\targ3\tcount\ttaken\tconstruct\tcomment\n");
+  for (loc = 0 ; loc < iaddrSize ; loc++)
+    if (profCount[loc] > 0)
+      fprintf(out, "%d\t%s\t%d\t%d\t%d\t%ld\t%ld\t%s\t%s\n", loc,
+              opCodeTab[iMem[loc].iop], iMem[loc].iarg1, iMem[loc].iarg2,
+              iMem[loc].iarg3, profCount[loc],
+              isJump(iMem[loc].iop) ? profTaken[loc] : 0L,
+              PROFCONSTRUCT(loc), PROFCOMMENT(loc));
+  return (fclose(out) == 0);
+} /* dumpProfile */
+
+/********************************************/
+/* reportProfile prints the report and      */
+/* writes the dump after a run              */
+/********************************************/
+void reportProfile (FILE * out)
+{ if ( ! profflag ) return;
+  printProfile (out);
+  if ( profName != NULL ) dumpProfile (profName);
+} /* reportProfile */
 
 /********************************************/
 int doCommand (void)
@@ -402,14 +1163,10 @@ int doCommand (void)
   int stepcnt=0, i;
   int printcnt;
   int stepResult;
-  int regNo, loc;
   do
   { printf ("Enter command: ");
-    fflush (stdin);
     fflush (stdout);
-    gets(in_Line);
-    lineLen = strlen(in_Line);
-    inCol = 0;
+    if ( ! readLine () ) return FALSE;
   }
   while (! getWord ());
 
@@ -422,6 +1179,12 @@ int doCommand (void)
       if ( traceflag ) printf("on.\n"); else printf("off.\n");
       break;
 
+    case 'e' :
+    /***********************************/
+      engine = (engine == engSTEP) ? engTHREADED : engSTEP ;
+      printf("Execution engine now %s.\n", engineTab[engine]);
+      break;
+
     case 'h' :
     /***********************************/
       printf("Commands are:\n");
@@ -440,6 +1203,9 @@ int doCommand (void)
       printf("   p(rint         "\
              "Toggle print of total instructions executed"\
              " ('go' only)\n");
+      printf("   e(ngine        "\
+             "Toggle step/threaded execution engine"\
+             " ('go' only)\n");
       printf("   c(lear         "\
              "Reset simulator for new execution of program\n");
       printf("   h(elp          "\
@@ -482,7 +1248,7 @@ int doCommand (void)
       if ( ! atEOL ())
         printf ("Instruction locations?\n");
       else
-      { while ((iloc >= 0) && (iloc < IADDR_SIZE)
+      { while ((iloc >= 0) && (iloc < iaddrSize)
                 && (printcnt > 0) )
         { writeInstruction(iloc);
           iloc++ ;
@@ -501,7 +1267,7 @@ int doCommand (void)
       if ( ! atEOL ())
         printf("Data locations?\n");
       else
-      { while ((dloc >= 0) && (dloc < DADDR_SIZE)
+      { while ((dloc >= 0) && (dloc < daddrSize)
                   && (printcnt > 0))
         { printf("%5d: %5d\n",dloc,dMem[dloc]);
           dloc++;
@@ -515,11 +1281,8 @@ int doCommand (void)
       iloc = 0;
       dloc = 0;
       stepcnt = 0;
-      for (regNo = 0;  regNo < NO_REGS ; regNo++)
-            reg[regNo] = 0 ;
-      dMem[0] = DADDR_SIZE - 1 ;
-      for (loc = 1 ; loc < DADDR_SIZE ; loc++)
-            dMem[loc] = 0 ;
+      clearMachine ();
+      if ( profflag ) clearProfile ();
       break;
 
     case 'q' : return FALSE;  /* break; */
@@ -529,15 +1292,26 @@ int doCommand (void)
   stepResult = srOKAY;
   if ( stepcnt > 0 )
   { if ( cmd == 'g' )
-    { stepcnt = 0;
-      while (stepResult == srOKAY)
-      { iloc = reg[PC_REG] ;
-        if ( traceflag ) writeInstruction( iloc ) ;
-        stepResult = stepTM ();
-        stepcnt++;
-      }
+    { clock_t start = clock();
+      double secs;
+      stepcnt = 0;
+      if ( (engine == engTHREADED) && ! traceflag )
+        stepResult = runThreaded (&stepcnt);
+      else
+        while (stepResult == srOKAY)
+        { iloc = reg[PC_REG] ;
+          if ( traceflag ) writeInstruction( iloc ) ;
+          stepResult = stepTM ();
+          stepcnt++;
+        }
+      secs = (double) (clock() - start) / CLOCKS_PER_SEC;
       if ( icountflag )
-        printf("Number of instructions executed = %d\n",stepcnt);
+      { printf("Number of instructions executed = %d\n",stepcnt);
+        printf("Execution time (%s engine) = %.3f sec, "
+               "%.2f ns/instruction\n", engineTab[engine], secs,
+               (stepcnt > 0) ? secs * 1e9 / stepcnt : 0.0);
+      }
+      reportProfile (stdout);
     }
     else
     { while ((stepcnt > 0) && (stepResult == srOKAY))
@@ -553,16 +1327,100 @@ int doCommand (void)
 } /* doCommand */
 
 
+/********************************************/
+/* runBatch executes the program to the end */
+/* without prompts; the result becomes the  */
+/* exit status (0 for HALT)                 */
+/********************************************/
+int runBatch (void)
+{ int stepcnt = 0;
+  STEPRESULT stepResult = srOKAY;
+  if ( engine == engTHREADED )
+    stepResult = runThreaded (&stepcnt);
+  else
+    while (stepResult == srOKAY)
+    { stepResult = stepTM ();
+      stepcnt++;
+    }
+  fflush(outStream);
+  if ( icountflag )
+    fprintf(stderr,"Number of instructions executed = %d\n",stepcnt);
+  reportProfile (stderr);
+  if ( stepResult != srHALT )
+  { fprintf(stderr,"%s (pc = %d)\n",
+            stepResultTab[stepResult], reg[PC_REG]);
+    return stepResult;
+  }
+  return 0;
+} /* runBatch */
+
 /********************************************/
 /* E X E C U T I O N   B E G I N S   H E R E */
 /********************************************/
 
 main( int argc, char * argv[] )
-{ if (argc != 2)
-  { printf("usage: %s <filename>\n",argv[0]);
+{ int argi = 1;
+  char * objName = NULL;
+  char * textName = NULL;
+  char * inName = NULL;
+  char * outName = NULL;
+  char magic[sizeof(TMOBJ_MAGIC)-1];
+  int isObject;
+  while ((argi < argc - 1) && (argv[argi][0] == '-'))
+  { if (strcmp(argv[argi],"-r") == 0)
+    { batchflag = TRUE;
+      argi++;
+      continue;
+    }
+    if (strcmp(argv[argi],"-p") == 0)
+    { icountflag = TRUE;
+      argi++;
+      continue;
+    }
+    if (strcmp(argv[argi],"-O") == 0)
+    { fuseflag = TRUE;
+      argi++;
+      continue;
+    }
+    if (strcmp(argv[argi],"-P") == 0)
+    { profflag = TRUE;
+      argi++;
+      continue;
+    }
+    if (argi + 1 >= argc - 1) break;
+    if (strcmp(argv[argi],"-e") == 0)
+    { if (strcmp(argv[argi+1],"step") == 0) engine = engSTEP;
+      else if (strcmp(argv[argi+1],"threaded") == 0) engine = engTHREADED;
+      else break;
+    }
+    else if ((strcmp(argv[argi],"-i") == 0)
+             || (strcmp(argv[argi],"-d") == 0))
+    { long size = strtol(argv[argi+1], NULL, 0);
+      if ((size <= 0) || (size > MAX_ADDR_SIZE)) break;
+      if (argv[argi][1] == 'i') iaddrOption = (int) size;
+      else daddrOption = (int) size;
+    }
+    else if (strcmp(argv[argi],"-b") == 0) objName = argv[argi+1];
+    else if (strcmp(argv[argi],"-t") == 0) textName = argv[argi+1];
+    else if (strcmp(argv[argi],"-in") == 0) inName = argv[argi+1];
+    else if (strcmp(argv[argi],"-out") == 0) outName = argv[argi+1];
+    else if (strcmp(argv[argi],"-prof") == 0)
+    { profflag = TRUE;
+      profName = argv[argi+1];
+    }
+    else break;
+    argi += 2;
+  }
+  if ((argi != argc - 1) || (strlen(argv[argi]) + 4 > sizeof(pgmName)))
+  { printf("usage: %s [-e step|threaded] [-i iwords] [-d dwords]"
+           " [-b objfile] [-t textfile]\n"
+           "          [-r] [-p] [-in infile] [-out outfile]"
+           " [-O] [-P] [-prof dumpfile] <filename>\n",
+           argv[0]);
     exit(1);
   }
-  strcpy(pgmName,argv[1]) ;
+  if ((inName != NULL) || (outName != NULL)) batchflag = TRUE;
+  strcpy(pgmName,argv[argi]) ;
   if (strchr (pgmName, '.') == NULL)
      strcat(pgmName,".tm");
   pgm = fopen(pgmName,"r");
@@ -571,9 +1429,57 @@ main( int argc, char * argv[] )
     exit(1);
   }
 
-  /* read the program */
-  if ( ! readInstructions ())
+  /* read the program, either TM object or text */
+  isObject = (fread(magic, 1, sizeof(magic), pgm) == sizeof(magic))
+             && (memcmp(magic, TMOBJ_MAGIC, sizeof(magic)) == 0);
+  if (isObject)
+  { fclose(pgm);
+    if ( ! mapInstructions ())
+         exit(1) ;
+  }
+  else
+  { rewind(pgm);
+    if ( ! readInstructions ())
+         exit(1) ;
+  }
+  if ( ! allocDMem ())
+         exit(1) ;
+  clearMachine ();
+  /* conversion only: write the other format(s) and stop */
+  if ((objName != NULL) || (textName != NULL))
+  { if ((objName != NULL) && ! writeObject (objName))
+         exit(1) ;
+    if ((textName != NULL) && ! writeText (textName))
          exit(1) ;
+    return 0;
+  }
+  if ( profflag ) clearProfile ();
+  decodeInstructions ();
+  if ( fuseflag && ! profflag )
+  { int fused = fuseInstructions ();
+    if ( icountflag )
+      fprintf(batchflag ? stderr : stdout,
+              "Fused %d instruction sequences\n", fused);
+  }
+  /* batch mode: IN values from infile (default stdin),
+   * OUT values block-buffered to outfile (default stdout)
+   */
+  if ( batchflag )
+  { inStream = stdin;
+    outStream = stdout;
+    if ((inName != NULL) && (strcmp(inName,"-") != 0)
+        && ((inStream = fopen(inName,"r")) == NULL))
+    { printf("file '%s' not found\n",inName);
+      exit(1);
+    }
+    if ((outName != NULL) && (strcmp(outName,"-") != 0)
+        && ((outStream = fopen(outName,"w")) == NULL))
+    { printf("Unable to open %s\n",outName);
+      exit(1);
+    }
+    setvbuf(outStream, NULL, _IOFBF, 1 << 16);
+    return runBatch ();
+  }
   /* switch input file to terminal */
   /* reset( input ); */
   /* read-eval-print */
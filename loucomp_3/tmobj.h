@@ -0,0 +1,38 @@
+/****************************************************/
+/* File: tmobj.h                                    */
+/* Binary object format for TM programs, shared by  */
+/* the code emitter and the TM simulator            */
+/****************************************************/
+
+#ifndef _TMOBJ_H_
+#define _TMOBJ_H_
+
+/* A TM object file is a header followed by one
+ * record per instruction location, starting at
+ * location 0. Each record is four native-order
+ * 32-bit ints laid out like TM's INSTRUCTION:
+ *   RR:  opcode, r, s, t
+ *   RM/RA:  opcode, r, d, s
+ * An all-zero record is "HALT 0,0,0", so locations
+ * that were skipped and never backpatched read as
+ * HALT, just as in the text loader.
+ */
+#define TMOBJ_MAGIC    "TMOB"
+#define TMOBJ_VERSION  1
+
+typedef struct {
+      char magic[4] ;
+      int version ;
+      int size ;     /* number of instruction records */
+      int dsize ;    /* data memory words wanted, 0 = default */
+   } TMOBJHEADER;
+
+/* TMOBJ_OPCODES lists the opcode mnemonics in
+ * record order; "????" marks the class limits
+ */
+#define TMOBJ_OPCODES \
+   "HALT","IN","OUT","ADD","SUB","MUL","DIV","????", \
+   "LD","ST","????", \
+   "LDA","LDC","JLT","JLE","JGT","JGE","JEQ","JNE","????"
+
+#endif
@@ -6,6 +6,7 @@
 /* Kenneth C. Louden                                */
 /****************************************************/
 
+#include <stddef.h>
 #include "globals.h"
 #include "util.h"
 
@@ -61,18 +62,118 @@ void printToken( TokenType token, const char* tokenString )
   }
 }
 
+/* ARENABLOCK is the size of an arena block; larger
+   requests get a block of their own */
+#define ARENABLOCK 65536
+
+/* ALIGN is the alignment of arena allocations */
+typedef union { long l; double d; void * p; } AlignRec;
+#define ALIGN sizeof(AlignRec)
+
+/* An arena is a list of blocks, the current one
+ * first, that are released together
+ */
+typedef struct arenaBlock
+   { struct arenaBlock * next;
+     size_t size, used;
+   } ArenaBlock;
+
+#define HEADSIZE ((sizeof(ArenaBlock) + ALIGN - 1) / ALIGN * ALIGN)
+
+static THREADLOCAL ArenaBlock * arenas[MAXARENA];
+
+/* allocations and bytes taken from the arenas, and
+ * tree nodes made, by this thread so far
+ */
+static THREADLOCAL long allocCount = 0;
+static THREADLOCAL long allocBytes = 0;
+static THREADLOCAL long nodeCount = 0;
+
+/* Function arenaAlloc returns n zeroed bytes from
+ * arena a
+ */
+void * arenaAlloc(ArenaKind a, size_t n)
+{ ArenaBlock * b = arenas[a];
+  void * p;
+  n = (n + ALIGN - 1) / ALIGN * ALIGN;
+  allocCount++;
+  allocBytes += n;
+  if ((b == NULL) || (b->used + n > b->size))
+  { size_t size = (n > ARENABLOCK / 4) ? n : ARENABLOCK;
+    b = (ArenaBlock *) calloc(1, HEADSIZE + size);
+    if (b == NULL)
+    { fprintf(listing,"Out of memory error at line %d\n",lineno);
+      exit(1);
+    }
+    b->size = size;
+    b->used = 0;
+    if ((size != ARENABLOCK) && (arenas[a] != NULL))
+    { /* keep filling the current block */
+      b->next = arenas[a]->next;
+      arenas[a]->next = b;
+    }
+    else
+    { b->next = arenas[a];
+      arenas[a] = b;
+    }
+  }
+  p = (char *) b + HEADSIZE + b->used;
+  b->used += n;
+  return p;
+}
+
+/* Function arenaGrow returns a copy in arena a,
+ * of size n, of the block p of size old; the old
+ * block stays in the arena until it is released
+ */
+void * arenaGrow(ArenaKind a, void * p, size_t old, size_t n)
+{ void * q = arenaAlloc(a,n);
+  if (p != NULL) memcpy(q,p,(old < n) ? old : n);
+  return q;
+}
+
+/* Procedure arenaCounts gives the number of arena
+ * allocations, their bytes and the number of tree
+ * nodes made by this thread so far
+ */
+void arenaCounts(long * allocs, long * bytes, long * nodes)
+{ *allocs = allocCount;
+  *bytes = allocBytes;
+  *nodes = nodeCount;
+}
+
+static void resetInterns(void);
+
+/* Procedure releaseArenas frees all arenas at the
+ * end of a compilation
+ */
+void releaseArenas(void)
+{ ArenaBlock * b;
+  int a;
+  for (a = 0; a < MAXARENA; a++)
+  { while ((b = arenas[a]) != NULL)
+    { arenas[a] = b->next;
+      free(b);
+    }
+  }
+  resetInterns();
+}
+
 /* Function newStmtNode creates a new statement
  * node for syntax tree construction
  */
 // pj2
 TreeNode * newBasicNode(void)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
+{ TreeNode * t = (TreeNode *) arenaAlloc(AstArena,sizeof(TreeNode));
+  nodeCount++;
   int i;
   if (t==NULL)
     fprintf(listing,"Out of memory error at line %d\n",lineno);
   else {
     for (i=0;i<MAXCHILDREN;i++) t->child[i] = NULL;
     t->sibling = NULL;
+    t->decl = NULL;
+    t->memloc = t->level = t->size = 0;
     t->nodekind = TypeK;
     t->lineno = lineno;
     t->type = Void;
@@ -82,13 +183,16 @@ TreeNode * newBasicNode(void)
 }
 
 TreeNode * newDeclNode(DeclKind kind)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
+{ TreeNode * t = (TreeNode *) arenaAlloc(AstArena,sizeof(TreeNode));
+  nodeCount++;
   int i;
   if (t==NULL)
     fprintf(listing,"Out of memory error at line %d\n",lineno);
   else {
     for (i=0;i<MAXCHILDREN;i++) t->child[i] = NULL;
     t->sibling = NULL;
+    t->decl = NULL;
+    t->memloc = t->level = t->size = 0;
     t->nodekind = DeclK;
     t->kind.decl = kind;
     t->lineno = lineno;
@@ -99,13 +203,16 @@ TreeNode * newDeclNode(DeclKind kind)
 }
 
 TreeNode * newStmtNode(StmtKind kind)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
+{ TreeNode * t = (TreeNode *) arenaAlloc(AstArena,sizeof(TreeNode));
+  nodeCount++;
   int i;
   if (t==NULL)
     fprintf(listing,"Out of memory error at line %d\n",lineno);
   else {
     for (i=0;i<MAXCHILDREN;i++) t->child[i] = NULL;
     t->sibling = NULL;
+    t->decl = NULL;
+    t->memloc = t->level = t->size = 0;
     t->nodekind = StmtK;
     t->kind.stmt = kind;
     t->lineno = lineno;
@@ -117,13 +224,16 @@ TreeNode * newStmtNode(StmtKind kind)
  * node for syntax tree construction
  */
 TreeNode * newExpNode(ExpKind kind)
-{ TreeNode * t = (TreeNode *) malloc(sizeof(TreeNode));
+{ TreeNode * t = (TreeNode *) arenaAlloc(AstArena,sizeof(TreeNode));
+  nodeCount++;
   int i;
   if (t==NULL)
     fprintf(listing,"Out of memory error at line %d\n",lineno);
   else {
     for (i=0;i<MAXCHILDREN;i++) t->child[i] = NULL;
     t->sibling = NULL;
+    t->decl = NULL;
+    t->memloc = t->level = t->size = 0;
     t->nodekind = ExpK;
     t->kind.exp = kind;
     t->lineno = lineno;
@@ -140,17 +250,107 @@ char * copyString(char * s)
   char * t;
   if (s==NULL) return NULL;
   n = strlen(s)+1;
-  t = malloc(n);
-  if (t==NULL)
-    fprintf(listing,"Out of memory error at line %d\n",lineno);
-  else strcpy(t,s);
+  t = (char *) arenaAlloc(StrArena,n);
+  strcpy(t,s);
   return t;
 }
 
+/* An interned string is stored after its hash, so
+ * that stringHash can find the hash from the string
+ */
+typedef struct
+   { unsigned hash;
+     char text[1];
+   } InternRec;
+
+#define internRec(s) ((InternRec *) ((s) - offsetof(InternRec,text)))
+
+/* the intern table: open addressing with linear
+ * probing, doubled when it gets half full
+ */
+static THREADLOCAL InternRec ** internTable = NULL;
+static THREADLOCAL int internSize = 0;
+static THREADLOCAL int internCount = 0;
+
+/* SHIFT is the power of two used as multiplier
+   in hash function  */
+#define SHIFT 4
+
+/* the hash function, of the first len characters of key */
+static unsigned hash ( char * key, int len )
+{ unsigned temp = 0;
+  int i = 0;
+  while (i < len)
+  { temp = (temp << SHIFT) + temp + (unsigned char) key[i];
+    ++i;
+  }
+  return temp;
+}
+
+/* Procedure growInterns doubles the intern table */
+static void growInterns(void)
+{ InternRec ** old = internTable;
+  int oldSize = internSize, i;
+  unsigned j, mask;
+  internSize = internSize ? 2 * internSize : 256;
+  internTable = (InternRec **) arenaAlloc(StrArena, internSize * sizeof(InternRec *));
+  mask = internSize - 1;
+  for (i = 0; i < oldSize; i++)
+    if (old[i] != NULL)
+    { for (j = old[i]->hash & mask; internTable[j] != NULL; j = (j + 1) & mask)
+        ;
+      internTable[j] = old[i];
+    }
+}
+
+/* Procedure resetInterns forgets all interned
+ * strings when their arena is released
+ */
+static void resetInterns(void)
+{ internTable = NULL;
+  internSize = internCount = 0;
+}
+
+/* Function internString returns the unique shared
+ * copy of string s
+ */
+char * internString(char * s)
+{ if (s==NULL) return NULL;
+  return internText(s,strlen(s));
+}
+
+/* Function internText returns the unique shared
+ * copy of the len characters at s
+ */
+char * internText(char * s, int len)
+{ unsigned h, j, mask;
+  InternRec * r;
+  if (2 * (internCount + 1) > internSize) growInterns();
+  h = hash(s,len);
+  mask = internSize - 1;
+  for (j = h & mask; (r = internTable[j]) != NULL; j = (j + 1) & mask)
+    if ((r->hash == h) && (strncmp(r->text,s,len) == 0) && (r->text[len] == '\0'))
+      return r->text;
+  r = (InternRec *) arenaAlloc(StrArena, offsetof(InternRec,text) + len + 1);
+  r->hash = h;
+  memcpy(r->text,s,len);
+  r->text[len] = '\0';
+  internTable[j] = r;
+  internCount++;
+  return r->text;
+}
+
+/* Function stringHash returns the hash of an
+ * interned string
+ */
+unsigned stringHash(char * s)
+{ return internRec(s)->hash;
+}
+
 /* Variable indentno is used by printTree to
  * store current number of spaces to indent
  */
-static int indentno = 0;
+static THREADLOCAL int indentno = 0;
 
 /* macros to increase/decrease indentation */
 #define INDENT indentno+=2
@@ -8,6 +8,33 @@
 #ifndef _UTIL_H_
 #define _UTIL_H_
 
+/* A compilation allocates its syntax tree, its
+ * symbol table and its strings from three arenas,
+ * released together by releaseArenas
+ */
+typedef enum { AstArena, SymArena, StrArena, MAXARENA } ArenaKind;
+
+/* Function arenaAlloc returns n zeroed bytes
+ * from arena a
+ */
+void * arenaAlloc( ArenaKind a, size_t n );
+
+/* Function arenaGrow returns a copy of block p
+ * of size old resized to n bytes in arena a
+ */
+void * arenaGrow( ArenaKind a, void * p, size_t old, size_t n );
+
+/* Procedure arenaCounts gives the number of arena
+ * allocations and their bytes, and the number of
+ * tree nodes, made by this thread so far
+ */
+void arenaCounts( long * allocs, long * bytes, long * nodes );
+
+/* Procedure releaseArenas frees every arena; all
+ * tree nodes, symbols and strings become invalid
+ */
+void releaseArenas( void );
+
 /* Procedure printToken prints a token 
  * and its lexeme to the listing file
  */
@@ -28,10 +55,29 @@ TreeNode * newStmtNode(StmtKind);
 TreeNode * newExpNode(ExpKind);
 
 /* Function copyString allocates and makes a new
- * copy of an existing string
+ * copy of an existing string in the string arena
  */
 char * copyString( char * );
 
+/* Function internString returns the unique shared
+ * copy of string s; equal strings are interned to
+ * the same pointer. Interned strings live in the
+ * string arena: they stay valid until releaseArenas,
+ * which frees them after each compilation, and must
+ * not be modified
+ */
+char * internString( char * );
+
+/* Function internText interns the len characters
+ * at s, which need not end the string
+ */
+char * internText( char *, int );
+
+/* Function stringHash returns the hash of an
+ * interned string, computed once by internString
+ */
+unsigned stringHash( char * );
+
 /* procedure printTree prints a syntax tree to the 
  * listing file using indentation to indicate subtrees
  */